@@ -0,0 +1,491 @@
+// Benchmarks for the Database in datamanager.cpp, on a generated
+// timetable. Each one times the current code against the way it was done
+// before, which is kept here (OLD PATHS) for comparison:
+//
+//   lookup   train by number: trainNo index against a linear scan
+//   pnr      PNRs made per second on 1 and 8 threads, and repeats among
+//            them, against rand() % 900000 + 100000
+//   csv      trains.csv and bookings.csv (10 bookings per train) rows per
+//            second: mapped CsvReader against getline + split, and the
+//            whole booking load
+//   names    name searches per second: SIMD NameScanner and the trigram
+//            index against lower-casing every name per query
+//
+// Runs on bench.* files next to the program and removes them again, so
+// real trains and bookings are never touched.
+//
+//   bench             10k and 100k trains (pnr runs once)
+//   bench <trains>    one size
+#define BOOKINGD_NO_MAIN
+#include "datamanager.cpp"
+
+#include <unordered_set>
+
+static const char *PREFIX = "bench.";
+
+// -------------------- FILES --------------------
+// Everything the Database reads or writes goes under PREFIX
+static void usePrefix(Database &db) {
+    db.trainFile = PREFIX + db.trainFile;
+    db.stopFile = PREFIX + db.stopFile;
+    db.trainSnapshot = PREFIX + db.trainSnapshot;
+    db.pnrFile = PREFIX + db.pnrFile;
+    db.bookingFile = PREFIX + db.bookingFile;
+    db.journalFile = PREFIX + db.journalFile;
+    db.bookingSnapshot = PREFIX + db.bookingSnapshot;
+    db.shardMarker = PREFIX + db.shardMarker;
+    db.archiveFile = PREFIX + db.archiveFile;
+    db.rejectFile = PREFIX + db.rejectFile;
+    for (int k = 0; k < SHARD_COUNT; k++) {
+        db.shards[k].bookingFile = PREFIX + db.shards[k].bookingFile;
+        db.shards[k].journalFile = PREFIX + db.shards[k].journalFile;
+        db.shards[k].bookingSnapshot = PREFIX + db.shards[k].bookingSnapshot;
+    }
+}
+
+static void removeFiles() {
+    Database db;
+    usePrefix(db);
+    remove(db.trainFile.c_str());
+    remove(db.trainSnapshot.c_str());
+    remove(db.pnrFile.c_str());
+    remove(db.bookingFile.c_str());
+    remove(db.journalFile.c_str());
+    remove(db.bookingSnapshot.c_str());
+    remove(db.shardMarker.c_str());
+    remove(db.archiveFile.c_str());
+    remove(db.rejectFile.c_str());
+    for (int k = 0; k < SHARD_COUNT; k++) {
+        remove(db.shards[k].bookingFile.c_str());
+        remove(db.shards[k].journalFile.c_str());
+        remove(db.shards[k].bookingSnapshot.c_str());
+    }
+}
+
+// -------------------- GENERATED DATA --------------------
+static const char *STATIONS[] = {
+    "New Delhi", "Kathgodam", "Jaisalmer", "Mumbai Central", "Howrah", "Chennai Central",
+    "Bengaluru", "Secunderabad", "Ahmedabad", "Pune", "Lucknow", "Patna",
+    "Bhopal", "Jaipur", "Amritsar", "Guwahati", "Varanasi", "Madgaon",
+};
+static const int STATION_COUNT = sizeof(STATIONS) / sizeof(STATIONS[0]);
+
+static const char *KINDS[] = {"Express", "Mail", "Superfast", "Shatabdi", "Rajdhani", "Passenger"};
+static const int KIND_COUNT = sizeof(KINDS) / sizeof(KINDS[0]);
+
+// Small LCG, so every run sees the same data
+static unsigned int nextRandom(unsigned int &seed) {
+    seed = seed * 1103515245u + 12345u;
+    return seed >> 8;
+}
+
+// Train numbers are 10000, 10001, ... so a key can be made without the file
+static string trainNumber(int i) {
+    return to_string(10000 + i);
+}
+
+static bool writeTrains(const string &path, int count) {
+    ofstream file(path.c_str());
+    if (!file.is_open()) return false;
+
+    unsigned int seed = 1;
+    file << "Train No,Train Name,From,To,Arrival,Departure,Stop,Classes\n";
+    for (int i = 0; i < count; i++) {
+        const char *from = STATIONS[nextRandom(seed) % STATION_COUNT];
+        const char *to = STATIONS[nextRandom(seed) % STATION_COUNT];
+        const char *kind = KINDS[nextRandom(seed) % KIND_COUNT];
+        int dep = nextRandom(seed) % (24 * 60);
+        int arr = nextRandom(seed) % (24 * 60);
+        file << trainNumber(i) << "," << from << " - " << to << " " << kind << " " << i << ","
+             << from << "," << to << "," << formatTime(arr) << "," << formatTime(dep) << ",Major,"
+             << "1A 2A 3A SL\n";
+    }
+    return file.good();
+}
+
+// Bookings spread over every train, the first four classes and 30 days
+static bool writeBookings(const string &path, int trains, int count) {
+    ofstream file(path.c_str());
+    if (!file.is_open()) return false;
+
+    PnrGenerator gen;
+    unsigned int seed = 3;
+    int first = today();
+    file << "pnr,name,age,trainNo,trainName,classType,seatNo,fare,departure,from,to,date\n";
+    for (int i = 0; i < count; i++) {
+        int train = i % trains;
+        int c = nextRandom(seed) % 4;
+        file << gen.make() << ",Passenger " << i << "," << 18 + nextRandom(seed) % 60 << ","
+             << trainNumber(train) << ",," << CLASS_CODES[c] << "," << 1 + i / trains << ",1000,,,,"
+             << formatDate(first + nextRandom(seed) % 30) << "\n";
+    }
+    return file.good();
+}
+
+static double secondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// -------------------- OLD PATHS --------------------
+// findByNumber() before the trainNo index: compare every train's number
+static const Train *scanForNumber(Database &db, const string &no) {
+    for (int i = 0; i < db.trains.size(); i++) {
+        if (db.pool.str(db.trains[i].trainNo) == no) {
+            return &db.trains[i];
+        }
+    }
+    return NULL;
+}
+
+// loadTrains() / loadBookings() before the mapped loader: getline, then
+// split() builds every field a char at a time and trim() copies it again
+struct OldTrain {
+    string trainNo;
+    string trainName;
+    string from;
+    string to;
+    string arr;
+    string dep;
+    string stop;
+    set<string> classes;
+};
+
+struct OldBooking {
+    string pnr;
+    string name;
+    int age;
+    string trainNo;
+    string trainName;
+    string classType;
+    int seatNo;
+    int fare;
+    string departure;
+};
+
+static string oldTrim(string s) {
+    int start = s.find_first_not_of(" \t\r\n");
+    if (start == string::npos) return "";
+    int end = s.find_last_not_of(" \t\r\n");
+    return s.substr(start, end - start + 1);
+}
+
+static vector<string> oldSplit(string line, char d) {
+    vector<string> result;
+    string word = "";
+    for (int i = 0; i < (int)line.size(); i++) {
+        if (line[i] == d) {
+            result.push_back(oldTrim(word));
+            word = "";
+        } else {
+            word += line[i];
+        }
+    }
+    result.push_back(oldTrim(word));
+    return result;
+}
+
+static int oldLoadTrains(const string &path) {
+    vector<OldTrain> trains;
+    ifstream file(path.c_str());
+    string line;
+    bool skip = true;
+    while (getline(file, line)) {
+        if (skip) { skip = false; continue; }
+        if (line == "") continue;
+
+        vector<string> p = oldSplit(line, ',');
+        if (p.size() < 8) continue;
+
+        OldTrain t;
+        t.trainNo = p[0];
+        t.trainName = p[1];
+        t.from = p[2];
+        t.to = p[3];
+        t.arr = p[4];
+        t.dep = p[5];
+        t.stop = p[6];
+        stringstream ss(p[7]);
+        string c;
+        while (ss >> c) {
+            t.classes.insert(c);
+        }
+        trains.push_back(t);
+    }
+    return trains.size();
+}
+
+static int oldLoadBookings(const string &path) {
+    vector<OldBooking> bookings;
+    ifstream file(path.c_str());
+    string line;
+    bool skip = true;
+    while (getline(file, line)) {
+        if (skip) { skip = false; continue; }
+        if (line == "") continue;
+
+        vector<string> p = oldSplit(line, ',');
+        if (p.size() < 9) continue;
+
+        OldBooking b;
+        b.pnr = p[0];
+        b.name = p[1];
+        b.age = atoi(p[2].c_str());
+        b.trainNo = p[3];
+        b.trainName = p[4];
+        b.classType = p[5];
+        b.seatNo = atoi(p[6].c_str());
+        b.fare = atoi(p[7].c_str());
+        b.departure = p[8];
+        bookings.push_back(b);
+    }
+    return bookings.size();
+}
+
+// searchByName() before the scanner: a lower-cased copy of every name
+static string oldLower(string s) {
+    for (int i = 0; i < (int)s.size(); i++) {
+        s[i] = tolower(s[i]);
+    }
+    return s;
+}
+
+static int oldSearch(const vector<string> &names, const string &key) {
+    int hits = 0;
+    string low = oldLower(key);
+    for (int i = 0; i < names.size(); i++) {
+        string name = oldLower(names[i]);
+        if (name.find(low) != string::npos) hits++;
+    }
+    return hits;
+}
+
+// generatePNR() before the Feistel sequence
+static string randomPnr() {
+    int r = rand() % 900000 + 100000;
+    stringstream ss;
+    ss << r;
+    return ss.str();
+}
+
+// -------------------- BENCHMARKS --------------------
+// Lookups of random existing train numbers. The scan gets fewer lookups,
+// it would take minutes otherwise.
+static void benchLookup(Database &db, int trains) {
+    vector<string> keys;
+    unsigned int seed = 7;
+    for (int i = 0; i < 1000; i++) {
+        keys.push_back(trainNumber(nextRandom(seed) % trains));
+    }
+
+    int found = 0;
+    int indexRounds = 1000;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int r = 0; r < indexRounds; r++) {
+        for (int i = 0; i < keys.size(); i++) {
+            if (db.findByNumber(keys[i]) != NULL) found++;
+        }
+    }
+    double indexSeconds = secondsSince(start);
+
+    int scanLookups = max(100, 20000000 / trains);
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < scanLookups; i++) {
+        if (scanForNumber(db, keys[i % keys.size()]) != NULL) found++;
+    }
+    double scanSeconds = secondsSince(start);
+
+    double indexRate = indexRounds * keys.size() / indexSeconds;
+    double scanRate = scanLookups / scanSeconds;
+    bool allFound = found == indexRounds * (int)keys.size() + scanLookups;
+    printf("lookup  %7d trains  index %12.0f /s  scan %12.0f /s  %6.0fx%s\n", trains, indexRate, scanRate,
+           indexRate / scanRate, allFound ? "" : "  MISSED");
+}
+
+// PNRs made by `threads` threads sharing one generator, as the service does
+static double pnrRate(int threads, int perThread, vector<vector<string> > &made) {
+    PnrGenerator gen;
+    made.assign(threads, vector<string>());
+    vector<thread> pool;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int k = 0; k < threads; k++) {
+        pool.push_back(thread([&gen, &made, k, perThread]() {
+            made[k].reserve(perThread);
+            for (int i = 0; i < perThread; i++) {
+                made[k].push_back(gen.make());
+            }
+        }));
+    }
+    for (int k = 0; k < threads; k++) {
+        pool[k].join();
+    }
+    return threads * (double)perThread / secondsSince(start);
+}
+
+static int repeats(const vector<vector<string> > &made) {
+    unordered_set<string> seen;
+    int n = 0;
+    for (int k = 0; k < made.size(); k++) {
+        for (int i = 0; i < made[k].size(); i++) {
+            if (!seen.insert(made[k][i]).second) n++;
+        }
+    }
+    return n;
+}
+
+static int benchPnr() {
+    const int COUNT = 2000000;
+    vector<vector<string> > made;
+
+    double one = pnrRate(1, COUNT, made);
+    int oneRepeats = repeats(made);
+    double eight = pnrRate(8, COUNT / 8, made);
+    int eightRepeats = repeats(made);
+
+    srand(1);
+    made.assign(1, vector<string>());
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int i = 0; i < COUNT; i++) {
+        made[0].push_back(randomPnr());
+    }
+    double old = COUNT / secondsSince(start);
+    int oldRepeats = repeats(made);
+
+    printf("pnr     %7d made    1 thread %10.0f /s  8 threads %10.0f /s  repeats %d/%d\n", COUNT, one, eight,
+           oneRepeats, eightRepeats);
+    printf("pnr     %7d made    rand()   %10.0f /s                          repeats %d\n", COUNT, old,
+           oldRepeats);
+    return oneRepeats + eightRepeats == 0 ? 0 : 1;
+}
+
+// Rows with at least `fields` fields, split into string_views in place
+static int mappedRows(const string &path, int fields) {
+    MappedFile file;
+    if (!file.open(path)) return 0;
+    CsvReader csv(file.data, file.size);
+    vector<string_view> p;
+    csv.next(p, ',');   // header
+
+    int rows = 0;
+    while (csv.next(p, ',')) {
+        if (p.size() >= fields) rows++;
+    }
+    return rows;
+}
+
+static void benchCsv(Database &db, int trains) {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    int oldRows = oldLoadTrains(db.trainFile);
+    double oldRate = oldRows / secondsSince(start);
+
+    start = chrono::steady_clock::now();
+    int rows = mappedRows(db.trainFile, 8);
+    double rate = rows / secondsSince(start);
+    printf("csv     %7d trains    mapped %10.0f rows/s  getline %10.0f rows/s  %5.1fx\n", rows, rate, oldRate,
+           rate / oldRate);
+
+    int count = trains * 10;
+    if (!writeBookings(db.bookingFile, trains, count)) {
+        cerr << "Cannot write " << db.bookingFile << "\n";
+        return;
+    }
+
+    start = chrono::steady_clock::now();
+    oldRows = oldLoadBookings(db.bookingFile);
+    oldRate = oldRows / secondsSince(start);
+
+    start = chrono::steady_clock::now();
+    rows = mappedRows(db.bookingFile, 9);
+    rate = rows / secondsSince(start);
+    printf("csv     %7d bookings  mapped %10.0f rows/s  getline %10.0f rows/s  %5.1fx\n", rows, rate, oldRate,
+           rate / oldRate);
+
+    // parse, intern, claim seats and store, as loadBookings() does
+    start = chrono::steady_clock::now();
+    db.loadBookingFiles(db.bookingFile, db.bookingSnapshot, db.journalFile, NULL);
+    double loadRate = count / secondsSince(start);
+    int loaded = 0;
+    for (int k = 0; k < SHARD_COUNT; k++) {
+        loaded += db.shards[k].bookings.liveCount;
+    }
+    printf("csv     %7d bookings  full load %7.0f rows/s%s\n", loaded, loadRate, loaded == count ? "" : "  LOST ROWS");
+}
+
+// Queries per second over all train names for each way of searching
+static void benchNames(Database &db, int trains) {
+    static const char *KEYS[] = {"mail", "KATHGODAM", "rajdhani 9", "xq", "central - pune"};
+    static const int KEY_COUNT = sizeof(KEYS) / sizeof(KEYS[0]);
+
+    vector<string> names;
+    NameScanner scanner;
+    for (int i = 0; i < db.trains.size(); i++) {
+        names.push_back(db.pool.str(db.trains[i].trainName));
+        scanner.add(names.back());
+    }
+
+    int rounds = max(1, 2000000 / trains);
+    long long scanHits = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+        for (int k = 0; k < KEY_COUNT; k++) {
+            scanHits += scanner.find(KEYS[k]).size();
+        }
+    }
+    double scanRate = rounds * KEY_COUNT / secondsSince(start);
+
+    // name and stations, so it finds at least what the scanner does
+    long long gramHits = 0;
+    start = chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) {
+        for (int k = 0; k < KEY_COUNT; k++) {
+            gramHits += db.grams.find(KEYS[k]).size();
+        }
+    }
+    double gramRate = rounds * KEY_COUNT / secondsSince(start);
+
+    long long oldHits = 0;
+    int oldRounds = max(1, rounds / 20);
+    start = chrono::steady_clock::now();
+    for (int r = 0; r < oldRounds; r++) {
+        for (int k = 0; k < KEY_COUNT; k++) {
+            oldHits += oldSearch(names, KEYS[k]);
+        }
+    }
+    double oldRate = oldRounds * KEY_COUNT / secondsSince(start);
+
+    bool agree = scanHits / rounds == oldHits / oldRounds && gramHits >= scanHits;
+    printf("names   %7d names   scanner %9.0f /s  trigram %9.0f /s  lower-case %7.0f /s  %5.1fx%s\n", trains,
+           scanRate, gramRate, oldRate, scanRate / oldRate, agree ? "" : "  MISMATCH");
+}
+
+static int run(int trains) {
+    removeFiles();
+    Database db;
+    usePrefix(db);
+    if (!writeTrains(db.trainFile, trains) || !db.loadTrains()) {
+        cerr << "Cannot write " << db.trainFile << "\n";
+        return 1;
+    }
+
+    benchLookup(db, trains);
+    benchNames(db, trains);
+    benchCsv(db, trains);
+
+    removeFiles();
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    vector<int> sizes;
+    if (argc > 1) {
+        sizes.push_back(max(toInt(argv[1]), 1));
+    } else {
+        sizes.push_back(10000);
+        sizes.push_back(100000);
+    }
+
+    int errors = benchPnr();
+    for (int i = 0; i < sizes.size(); i++) {
+        errors += run(sizes[i]);
+    }
+    return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,16 @@
+// Booking file layout that train.exe (main.cpp) and bookingd
+// (datamanager.cpp) both depend on. Each is built from one .cpp, so this
+// is the only header they share.
+#ifndef BOOKINGFILES_H
+#define BOOKINGFILES_H
+
+// bookingd splits the bookings by train into bookings.0.csv ..
+// bookings.<SHARD_COUNT - 1>.csv, each with its own .bin and .journal
+static const int SHARD_COUNT = 8;
+
+// Written by bookingd, holding SHARD_COUNT, once every shard file of the
+// conversion from bookings.csv is on disk. Until it exists bookings.csv is
+// still the real store and a half-done conversion is simply redone.
+static const char *const SHARD_MARKER = "bookings.shards";
+
+#endif
@@ -4,263 +4,3335 @@
 #include <vector>
 #include <map>
 #include <set>
+#include <unordered_map>
+#include <deque>
 #include <algorithm>
 #include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <string_view>
 #include <ctime>
+#include <csignal>
+#include <cerrno>
+
+#include <sys/stat.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <winsock2.h>
+#include <afunix.h>
+#include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#include "bookingfiles.h"
 using namespace std;
 
+// -------------------- SOCKETS --------------------
+// The few calls that differ between Winsock and POSIX sockets
+#ifdef _WIN32
+typedef SOCKET socket_t;
+static const socket_t BAD_SOCKET = INVALID_SOCKET;
+
+static void closeSocket(socket_t s) {
+    closesocket(s);
+}
+
+static void setNonBlocking(socket_t s) {
+    u_long on = 1;
+    ioctlsocket(s, FIONBIO, &on);
+}
+
+static bool wouldBlock() {
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+}
+
+static int pollSockets(pollfd *fds, size_t n, int timeoutMs) {
+    return WSAPoll(fds, n, timeoutMs);
+}
+#else
+typedef int socket_t;
+static const socket_t BAD_SOCKET = -1;
+
+static void closeSocket(socket_t s) {
+    close(s);
+}
+
+static void setNonBlocking(socket_t s) {
+    fcntl(s, F_SETFL, fcntl(s, F_GETFL, 0) | O_NONBLOCK);
+}
+
+static bool wouldBlock() {
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+}
+
+static int pollSockets(pollfd *fds, size_t n, int timeoutMs) {
+    return poll(fds, n, timeoutMs);
+}
+#endif
+
+// -------------------- TRAVEL CLASSES --------------------
+enum TravelClass {
+    CLASS_1A,
+    CLASS_2A,
+    CLASS_3A,
+    CLASS_3E,
+    CLASS_SL,
+    CLASS_CC,
+    CLASS_2S,
+    CLASS_COUNT
+};
+
+static const char *CLASS_CODES[CLASS_COUNT] = {"1A", "2A", "3A", "3E", "SL", "CC", "2S"};
+
+// Class for a code such as "SL"; CLASS_COUNT if the code is unknown
+static TravelClass classFromCode(string_view code) {
+    for (int c = 0; c < CLASS_COUNT; c++) {
+        if (code == CLASS_CODES[c]) return (TravelClass)c;
+    }
+    return CLASS_COUNT;
+}
+
+static unsigned int classBit(TravelClass c) {
+    return 1u << c;
+}
+
+// -------------------- STRING POOL --------------------
+// Each distinct string is stored once and handed out as a small integer
+// id. Values sit in a deque so the string_view keys never move.
+struct StringPool {
+    deque<string> values;
+    unordered_map<string_view, int> ids;
+
+    int intern(string_view s) {
+        unordered_map<string_view, int>::iterator it = ids.find(s);
+        if (it != ids.end()) return it->second;
+
+        values.push_back(string(s));
+        int id = values.size() - 1;
+        ids[values.back()] = id;
+        return id;
+    }
+
+    // Id of an already interned string, or -1 (never adds)
+    int find(string_view s) const {
+        unordered_map<string_view, int>::const_iterator it = ids.find(s);
+        if (it == ids.end()) return -1;
+        return it->second;
+    }
+
+    const string &str(int id) const {
+        return values[id];
+    }
+
+    int size() const {
+        return values.size();
+    }
+};
+
 // -------------------- TRAIN STRUCT --------------------
+// Number, name and stations are StringPool ids
 struct Train {
-    string trainNo;
-    string trainName;
-    string from;
-    string to;
-    string arr;
-    string dep;
+    int trainNo;
+    int trainName;
+    int from;
+    int to;
+    short arr;              // minutes since midnight at the terminus, -1 if unknown
+    short dep;              // minutes since midnight at the origin, -1 if unknown
     string stop;
-    set<string> classes;
+    unsigned int classes;   // classBit() of every class the train runs
+
+    bool hasClass(TravelClass c) const {
+        return (classes & classBit(c)) != 0;
+    }
+};
+
+// -------------------- STOPS --------------------
+// One call of a train at a station. Times are minutes since midnight, -1
+// where there is none (no arrival at the origin, no departure at the end).
+struct Stop {
+    int station;    // pool id
+    short arr;
+    short dep;
 };
 
+// Riding one train from one of its stops to a later one
+struct Leg {
+    int train;      // position in trains
+    int board;      // stop index within that train
+    int alight;
+    int trainNo;    // pool ids and the times at board/alight, so callers
+    int trainName;  // needn't look back into trains afterwards
+    short dep;
+    short arr;
+};
+
+// "HH:MM" -> minutes since midnight, -1 if it isn't a valid time
+static int parseTime(string_view s) {
+    size_t colon = s.find(':');
+    if (colon == string_view::npos || colon == 0 || colon > 2 || s.size() != colon + 3) return -1;
+
+    int h = 0, m = 0;
+    for (size_t i = 0; i < s.size(); i++) {
+        if (i == colon) continue;
+        if (s[i] < '0' || s[i] > '9') return -1;
+        if (i < colon) h = h * 10 + (s[i] - '0');
+        else m = m * 10 + (s[i] - '0');
+    }
+    if (h > 23 || m > 59) return -1;
+    return h * 60 + m;
+}
+
+// minutes since midnight -> "HH:MM", blank for -1
+static string formatTime(int minutes) {
+    if (minutes < 0) return "";
+    char buf[8];
+    snprintf(buf, sizeof(buf), "%02d:%02d", minutes / 60, minutes % 60);
+    return buf;
+}
+
+// -------------------- DATES --------------------
+// Journey dates are day numbers, days since 1970-01-01, so they sort and
+// subtract as plain ints. -1 means undated (bookings older than the field).
+
+// Proleptic Gregorian date -> day number
+static int daysFromCivil(int y, int m, int d) {
+    y -= m <= 2;
+    int era = (y >= 0 ? y : y - 399) / 400;
+    int yoe = y - era * 400;
+    int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+static void civilFromDays(int z, int &y, int &m, int &d) {
+    z += 719468;
+    int era = (z >= 0 ? z : z - 146096) / 146097;
+    int doe = z - era * 146097;
+    int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int mp = (5 * doy + 2) / 153;
+    d = doy - (153 * mp + 2) / 5 + 1;
+    m = mp + (mp < 10 ? 3 : -9);
+    y = yoe + era * 400 + (m <= 2);
+}
+
+// "YYYY-MM-DD" -> day number, -1 if it isn't a real date
+static int parseDate(string_view s) {
+    if (s.size() != 10 || s[4] != '-' || s[7] != '-') return -1;
+    for (int i = 0; i < 10; i++) {
+        if (i != 4 && i != 7 && (s[i] < '0' || s[i] > '9')) return -1;
+    }
+
+    int y = (s[0] - '0') * 1000 + (s[1] - '0') * 100 + (s[2] - '0') * 10 + (s[3] - '0');
+    int m = (s[5] - '0') * 10 + (s[6] - '0');
+    int d = (s[8] - '0') * 10 + (s[9] - '0');
+    if (m < 1 || m > 12 || d < 1 || d > 31) return -1;
+
+    int day = daysFromCivil(y, m, d);
+    int cy, cm, cd;
+    civilFromDays(day, cy, cm, cd);
+    if (cm != m || cd != d) return -1;   // 31st of a short month, 29 Feb
+    return day;
+}
+
+// day number -> "YYYY-MM-DD", blank for -1
+static string formatDate(int day) {
+    if (day < 0) return "";
+    int y, m, d;
+    civilFromDays(day, y, m, d);
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%04d-%02d-%02d", y, m, d);
+    return buf;
+}
+
+// Today's day number in local time (reentrant: called from any thread)
+static int today() {
+    time_t now = time(NULL);
+    struct tm t;
+#ifdef _WIN32
+    localtime_s(&t, &now);
+#else
+    localtime_r(&now, &t);
+#endif
+    return daysFromCivil(t.tm_year + 1900, t.tm_mon + 1, t.tm_mday);
+}
+
 // -------------------- BOOKING STRUCT --------------------
+// The train is referenced by its interned number; its name and departure
+// are looked up from the timetable rather than copied into every booking.
 struct Booking {
     string pnr;
     string name;
     int age;
-    string trainNo;
-    string trainName;
-    string classType;
+    int trainNo;
+    TravelClass classType;
     int seatNo;
     int fare;
-    string departure;
+    int from;   // boarding station id, -1 for the train's origin
+    int to;     // alighting station id, -1 for its terminus
+    int date;   // journey day number, -1 if undated
 };
 
-// -------------------- DATABASE CLASS --------------------
-class Database {
-public:
-    vector<Train> trains;
-    vector<Booking> bookings;
-    map<string, int> seatCapacity;
-    map<string, int> fares;
+// -------------------- SEAT MAP --------------------
+// Seat occupancy for one (train, class) per segment, the run between two
+// consecutive stops, so a seat given up at a stop can be sold again from
+// there. A segment tree over the segments keeps two bitmaps per node (bit i
+// is seat i + 1): cover, the seats booked across the node's whole range,
+// and any, the seats booked anywhere inside it. Booking, releasing or
+// checking a range of segments touches O(log segments) nodes.
+// Two bookings never share a seat on the same segment, so each cover bit
+// has a single owner and release() can simply clear it again.
+struct SeatMap {
+    int capacity;
+    int segments;
+    int leaves;     // segments rounded up to a power of two
+    int width;      // words per bitmap
+    int used;       // live reservations
+    vector<unsigned long long> cover;
+    vector<unsigned long long> any;
+    vector<unsigned long long> pad;     // bits past capacity, reported as taken
 
-    string trainFile;
-    string bookingFile;
+    // Seats picked by reserve() and not yet booked or released. Atomic so
+    // concurrent readers can claim them without an exclusive lock; a claim
+    // is one compare-and-swap on the seat's word.
+    mutable vector<atomic<unsigned long long> > held;
 
-    Database() {
-        trainFile = "trains.csv";
-        bookingFile = "bookings.csv";
+    SeatMap() {
+        capacity = 0;
+        segments = 1;
+        leaves = 1;
+        width = 1;
+        used = 0;
+    }
 
-        seatCapacity["1A"] = 20;
-        seatCapacity["2A"] = 40;
-        seatCapacity["3A"] = 60;
-        seatCapacity["3E"] = 70;
-        seatCapacity["SL"] = 120;
-        seatCapacity["CC"] = 80;
-        seatCapacity["2S"] = 100;
-
-        fares["1A"] = 2000;
-        fares["2A"] = 1500;
-        fares["3A"] = 1100;
-        fares["3E"] = 900;
-        fares["SL"] = 400;
-        fares["CC"] = 700;
-        fares["2S"] = 300;
-
-        srand(time(0));
-    }
-
-    // Trim spaces
-    string trim(string s) {
-        int start = s.find_first_not_of(" \t\r\n");
-        if (start == string::npos) return "";
-        int end = s.find_last_not_of(" \t\r\n");
-        return s.substr(start, end - start + 1);
-    }
-
-    // Split line by delimiter
-    vector<string> split(string line, char d) {
-        vector<string> result;
-        string word = "";
-        for (int i = 0; i < (int)line.size(); i++) {
-            if (line[i] == d) {
-                result.push_back(trim(word));
-                word = "";
-            } else {
-                word += line[i];
-            }
-        }
-        result.push_back(trim(word));
-        return result;
+    void resize(int cap, int segs) {
+        capacity = cap;
+        segments = max(segs, 1);
+        used = 0;
+        width = max((cap + 63) / 64, 1);
+
+        leaves = 1;
+        while (leaves < segments) leaves *= 2;
+        cover.assign(2 * leaves * width, 0);
+        any.assign(2 * leaves * width, 0);
+
+        pad.assign(width, 0);
+        if (cap % 64 != 0) pad.back() = ~0ULL << (cap % 64);
+        if (cap == 0) pad[0] = ~0ULL;
+
+        vector<atomic<unsigned long long> > fresh(width);
+        held.swap(fresh);
     }
 
-    string toLower(string s) {
-        for (int i = 0; i < (int)s.size(); i++) {
-            s[i] = tolower(s[i]);
-        }
-        return s;
+    bool validRange(int l, int r) const {
+        return l >= 0 && r <= segments && l < r;
     }
 
-    // ---------------- LOAD TRAINS ----------------
-    bool loadTrains() {
-        trains.clear();
-        ifstream file(trainFile.c_str());
-        if (!file.is_open()) return false;
+    // ORs into out (width words) every seat booked on some segment of [l, r)
+    void booked(int l, int r, unsigned long long *out) const {
+        collect(1, 0, leaves, l, r, out);
+        for (int w = 0; w < width; w++) out[w] |= pad[w];
+    }
 
-        string line;
-        bool skip = true;
+    void collect(int node, int lo, int hi, int l, int r, unsigned long long *out) const {
+        if (r <= lo || hi <= l) return;
+        bool inside = l <= lo && hi <= r;
+        const unsigned long long *bits = inside ? &any[node * width] : &cover[node * width];
+        for (int w = 0; w < width; w++) out[w] |= bits[w];
+        if (inside) return;
 
-        while (getline(file, line)) {
-            if (skip) { skip = false; continue; }
-            if (line == "") continue;
+        int mid = (lo + hi) / 2;
+        collect(2 * node, lo, mid, l, r, out);
+        collect(2 * node + 1, mid, hi, l, r, out);
+    }
 
-            vector<string> p = split(line, ',');
-            if (p.size() < 8) continue;
+    void mark(int node, int lo, int hi, int l, int r, int w, unsigned long long bit, bool on) {
+        if (r <= lo || hi <= l) return;
+        size_t i = (size_t)node * width + w;
+        if (l <= lo && hi <= r) {
+            if (on) cover[i] |= bit;
+            else cover[i] &= ~bit;
+        } else {
+            int mid = (lo + hi) / 2;
+            mark(2 * node, lo, mid, l, r, w, bit, on);
+            mark(2 * node + 1, mid, hi, l, r, w, bit, on);
+        }
 
-            Train t;
-            t.trainNo = p[0];
-            t.trainName = p[1];
-            t.from = p[2];
-            t.to = p[3];
-            t.arr = p[4];
-            t.dep = p[5];
-            t.stop = p[6];
+        any[i] = cover[i];
+        if (hi - lo > 1) any[i] |= any[(size_t)2 * node * width + w] | any[(size_t)(2 * node + 1) * width + w];
+    }
 
-            stringstream ss(p[7]);
-            string c;
-            while (ss >> c) {
-                t.classes.insert(c);
-            }
+    bool taken(int seat, int l, int r) const {
+        if (seat < 1 || seat > capacity || !validRange(l, r)) return true;
+        vector<unsigned long long> occ(width, 0);
+        booked(l, r, &occ[0]);
+        return (occ[(seat - 1) / 64] >> ((seat - 1) % 64)) & 1;
+    }
 
-            trains.push_back(t);
-        }
+    bool isHeld(int seat) const {
+        return (held[(seat - 1) / 64].load(memory_order_acquire) >> ((seat - 1) % 64)) & 1;
+    }
+
+    // Returns false if the seat is out of range, occupied anywhere on
+    // [l, r) or held by someone's reservation
+    bool take(int seat, int l, int r) {
+        if (taken(seat, l, r) || isHeld(seat)) return false;
+        mark(1, 0, leaves, l, r, (seat - 1) / 64, 1ULL << ((seat - 1) % 64), true);
+        used++;
         return true;
     }
 
-    // ---------------- LOAD BOOKINGS ----------------
-    bool loadBookings() {
-        bookings.clear();
-        ifstream file(bookingFile.c_str());
-        if (!file.is_open()) return true;
+    // take() for the reservation holding the seat: the hold becomes the
+    // booking. False if the hold is gone (e.g. the map was rebuilt).
+    bool takeHeld(int seat, int l, int r) {
+        if (taken(seat, l, r) || !isHeld(seat)) return false;
+        mark(1, 0, leaves, l, r, (seat - 1) / 64, 1ULL << ((seat - 1) % 64), true);
+        used++;
+        unhold(seat);
+        return true;
+    }
+
+    void release(int seat, int l, int r) {
+        if (seat < 1 || seat > capacity || !validRange(l, r) || !taken(seat, l, l + 1)) return;
+        mark(1, 0, leaves, l, r, (seat - 1) / 64, 1ULL << ((seat - 1) % 64), false);
+        used--;
+    }
+
+    // A seat free on all of [l, r), or -1. Seats already taken on both
+    // neighbouring segments come first, then those taken on one, so the
+    // remaining free stretches stay as long as possible for later riders.
+    // Held seats are skipped.
+    int firstFree(int l, int r) const {
+        return pick(l, r, false);
+    }
+
+    // firstFree(), but the seat is also held until unhold(): of two callers
+    // racing for it, only one wins the CAS and the other moves on
+    int reserve(int l, int r) const {
+        return pick(l, r, true);
+    }
 
-        string line;
-        bool skip = true;
+    // Keeps a seat nobody holds off the market, e.g. one freed by a cancel
+    // that isn't on disk yet
+    void hold(int seat) const {
+        if (seat < 1 || seat > capacity) return;
+        held[(seat - 1) / 64].fetch_or(1ULL << ((seat - 1) % 64), memory_order_acq_rel);
+    }
 
-        while (getline(file, line)) {
-            if (skip) { skip = false; continue; }
-            if (line == "") continue;
+    void unhold(int seat) const {
+        if (seat < 1 || seat > capacity) return;
+        held[(seat - 1) / 64].fetch_and(~(1ULL << ((seat - 1) % 64)), memory_order_release);
+    }
 
-            vector<string> p = split(line, ',');
-            if (p.size() < 9) continue;
+    int pick(int l, int r, bool hold) const {
+        if (!validRange(l, r)) return -1;
 
-            Booking b;
-            b.pnr = p[0];
-            b.name = p[1];
-            b.age = atoi(p[2].c_str());
-            b.trainNo = p[3];
-            b.trainName = p[4];
-            b.classType = p[5];
-            b.seatNo = atoi(p[6].c_str());
-            b.fare = atoi(p[7].c_str());
-            b.departure = p[8];
-
-            bookings.push_back(b);
+        vector<unsigned long long> occ(width, 0);
+        vector<unsigned long long> before(width, ~0ULL);
+        vector<unsigned long long> after(width, ~0ULL);
+        booked(l, r, &occ[0]);
+        if (l > 0) {
+            before.assign(width, 0);
+            booked(l - 1, l, &before[0]);
         }
-        return true;
+        if (r < segments) {
+            after.assign(width, 0);
+            booked(r, r + 1, &after[0]);
+        }
+
+        for (int pass = 0; pass < 3; pass++) {
+            for (int w = 0; w < width; w++) {
+                unsigned long long want = ~occ[w];
+                if (pass == 0) want &= before[w] & after[w];
+                if (pass == 1) want &= before[w] | after[w];
+
+                unsigned long long cur = held[w].load(memory_order_acquire);
+                unsigned long long free = want & ~cur;
+                while (free != 0) {
+                    unsigned long long bit = free & (0 - free);
+                    if (!hold) return w * 64 + __builtin_ctzll(bit) + 1;
+                    if (held[w].compare_exchange_weak(cur, cur | bit, memory_order_acq_rel)) {
+                        return w * 64 + __builtin_ctzll(bit) + 1;
+                    }
+                    // cur now holds the word's latest value
+                    free = want & ~cur;
+                }
+            }
+        }
+        return -1;
     }
 
-    // ---------------- SAVE BOOKINGS ----------------
-    bool saveBookings() {
-        ofstream file(bookingFile.c_str());
-        if (!file.is_open()) return false;
-
-        file << "pnr,name,age,trainNo,trainName,classType,seatNo,fare,departure\n";
-
-        for (int i = 0; i < bookings.size(); i++) {
-            Booking b = bookings[i];
-            file << b.pnr << "," 
-                 << b.name << "," 
-                 << b.age << ","
-                 << b.trainNo << "," 
-                 << b.trainName << ","
-                 << b.classType << "," 
-                 << b.seatNo << "," 
-                 << b.fare << ","
-                 << b.departure << "\n";
+    // Seats free on all of [l, r)
+    int freeCount(int l, int r) const {
+        if (!validRange(l, r)) return 0;
+        vector<unsigned long long> occ(width, 0);
+        booked(l, r, &occ[0]);
+
+        int n = 0;
+        for (int w = 0; w < width; w++) n += __builtin_popcountll(~occ[w]);
+        return n;
+    }
+};
+
+// -------------------- MAPPED FILE --------------------
+// Read-only memory map of a whole file. An empty or missing file maps to
+// size 0 so callers can treat both the same way.
+struct MappedFile {
+    const char *data;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+
+    MappedFile() {
+        data = NULL;
+        size = 0;
+#ifdef _WIN32
+        file = INVALID_HANDLE_VALUE;
+        mapping = NULL;
+#else
+        fd = -1;
+#endif
+    }
+
+    ~MappedFile() {
+        close();
+    }
+
+    bool open(const string &path) {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                           NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE) return false;
+
+        LARGE_INTEGER len;
+        if (!GetFileSizeEx(file, &len)) return false;
+        size = (size_t)len.QuadPart;
+        if (size == 0) return true;
+
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping == NULL) return false;
+        data = (const char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+        fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0) return false;
+        size = (size_t)st.st_size;
+        if (size == 0) return true;
+
+        void *p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) return false;
+        data = (const char *)p;
+#endif
+        return data != NULL;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (data != NULL) UnmapViewOfFile(data);
+        if (mapping != NULL) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        file = INVALID_HANDLE_VALUE;
+        mapping = NULL;
+#else
+        if (data != NULL) munmap((void *)data, size);
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+#endif
+        data = NULL;
+        size = 0;
+    }
+
+private:
+    MappedFile(const MappedFile &);
+    MappedFile &operator=(const MappedFile &);
+};
+
+// -------------------- APPEND FILE --------------------
+// Raw append-only file for the journals: unlike ofstream it can be synced,
+// so whatever was appended is on disk once sync() returns.
+struct AppendFile {
+    int fd;
+
+    AppendFile() {
+        fd = -1;
+    }
+
+    ~AppendFile() {
+        close();
+    }
+
+    bool isOpen() const {
+        return fd >= 0;
+    }
+
+    bool open(const string &path, bool truncate) {
+        close();
+#ifdef _WIN32
+        fd = _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY | (truncate ? _O_TRUNC : 0),
+                   _S_IREAD | _S_IWRITE);
+#else
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | (truncate ? O_TRUNC : 0), 0644);
+#endif
+        return fd >= 0;
+    }
+
+    bool append(const string &data) {
+        size_t done = 0;
+        while (done < data.size()) {
+#ifdef _WIN32
+            int n = _write(fd, data.data() + done, (unsigned int)(data.size() - done));
+#else
+            ssize_t n = write(fd, data.data() + done, data.size() - done);
+            if (n < 0 && errno == EINTR) continue;
+#endif
+            if (n <= 0) return false;
+            done += n;
         }
         return true;
     }
 
-    // ---------------- SEARCH BY NAME ----------------
-    vector<Train> searchByName(string key) {
-        vector<Train> result;
-        string low = toLower(key);
+    bool sync() {
+#ifdef _WIN32
+        return _commit(fd) == 0;
+#else
+        return fsync(fd) == 0;
+#endif
+    }
 
-        for (int i = 0; i < trains.size(); i++) {
-            string name = toLower(trains[i].trainName);
-            if (name.find(low) != string::npos) {
-                result.push_back(trains[i]);
-            }
+    void close() {
+        if (fd < 0) return;
+#ifdef _WIN32
+        _close(fd);
+#else
+        ::close(fd);
+#endif
+        fd = -1;
+    }
+};
+
+// -------------------- DURABLE FILES --------------------
+// Whole-file writes go to <path>.tmp, which is synced and then renamed over
+// path, so a crash leaves either the old file or the new one, never half.
+static bool replaceFile(const string &path, const string &data) {
+    string tmp = path + ".tmp";
+    AppendFile file;
+    if (!file.open(tmp, true)) return false;
+    bool ok = file.append(data) && file.sync();
+    file.close();
+#ifdef _WIN32
+    if (ok) ok = MoveFileExA(tmp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    if (ok) ok = rename(tmp.c_str(), path.c_str()) == 0;
+    if (ok) {
+        // the rename only survives a crash once the directory is synced
+        size_t slash = path.rfind('/');
+        string dir = slash == string::npos ? "." : path.substr(0, slash + 1);
+        int fd = ::open(dir.c_str(), O_RDONLY);
+        if (fd >= 0) {
+            fsync(fd);
+            ::close(fd);
         }
-        return result;
     }
+#endif
+    if (!ok) remove(tmp.c_str());
+    return ok;
+}
 
-    // ---------------- FIND BY NUMBER ----------------
-    const Train* findByNumber(string no) {
-        for (int i = 0; i < trains.size(); i++) {
-            if (trains[i].trainNo == no) {
-                return &trains[i];
+// Cuts a file back to its first `size` bytes
+static bool truncateFile(const string &path, long long size) {
+#ifdef _WIN32
+    int fd = _open(path.c_str(), _O_WRONLY | _O_BINARY);
+    if (fd < 0) return false;
+    bool ok = _chsize_s(fd, size) == 0 && _commit(fd) == 0;
+    _close(fd);
+    return ok;
+#else
+    return truncate(path.c_str(), size) == 0;
+#endif
+}
+
+// CRC-32 (IEEE), stamped on every journal record
+struct Crc32 {
+    unsigned int table[256];
+
+    Crc32() {
+        for (unsigned int i = 0; i < 256; i++) {
+            unsigned int c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
             }
+            table[i] = c;
         }
-        return NULL;
     }
 
-    // ---------------- BOOKED COUNT ----------------
-    int bookedCount(string trainNo, string cls) {
-        int count = 0;
-        for (int i = 0; i < bookings.size(); i++) {
-            if (bookings[i].trainNo == trainNo &&
-                bookings[i].classType == cls) {
-                count++;
-            }
+    unsigned int operator()(string_view s) const {
+        unsigned int c = 0xFFFFFFFFu;
+        for (size_t i = 0; i < s.size(); i++) {
+            c = table[(c ^ (unsigned char)s[i]) & 0xFF] ^ (c >> 8);
         }
-        return count;
+        return c ^ 0xFFFFFFFFu;
     }
+};
+
+static unsigned int crc32(string_view s) {
+    static const Crc32 crc;
+    return crc(s);
+}
+
+// A journal line is the record, then ",~" and the record's CRC in hex
+static string journalLine(const string &record) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), ",~%08x\n", crc32(record));
+    return record + buf;
+}
+
+// Checks a journal line (newline already cut) and strips its CRC field.
+// Lines written before records were checksummed have none and pass.
+static bool checkJournalLine(string_view &line) {
+    while (!line.empty() && line.back() == '\r') line.remove_suffix(1);
 
-    int nextSeat(string trainNo, string cls) {
-        return bookedCount(trainNo, cls) + 1;
+    size_t comma = line.rfind(',');
+    if (comma == string_view::npos || comma + 1 >= line.size() || line[comma + 1] != '~') return true;
+    if (line.size() - comma != 10) return false;
+
+    unsigned int stored = 0;
+    for (size_t i = comma + 2; i < line.size(); i++) {
+        char c = line[i];
+        int digit;
+        if (c >= '0' && c <= '9') digit = c - '0';
+        else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+        else return false;
+        stored = stored * 16 + digit;
     }
 
-    // ---------------- SIMPLE PNR GENERATOR ----------------
-    string generatePNR() {
-        int r = rand() % 900000 + 100000;
-        stringstream ss;
-        ss << r;
-        return ss.str();
+    line = line.substr(0, comma);
+    return crc32(line) == stored;
+}
+
+// -------------------- DIRECTORY LOCK --------------------
+// bookingd and the GUI keep separate booking files and PNR sequences, so
+// only one of them may run in a directory. Each holds bookings.lock while
+// it runs; the OS lets go of it if the process dies.
+struct DirectoryLock {
+#ifdef _WIN32
+    HANDLE file;
+#else
+    int fd;
+#endif
+
+    DirectoryLock() {
+#ifdef _WIN32
+        file = INVALID_HANDLE_VALUE;
+#else
+        fd = -1;
+#endif
     }
 
-    // ---------------- ADD BOOKING ----------------
-    bool addBooking(Booking b) {
-        bookings.push_back(b);
-        return saveBookings();
+    ~DirectoryLock() {
+#ifdef _WIN32
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+        if (fd >= 0) ::close(fd);
+#endif
     }
 
-    // ---------------- CANCEL BOOKING ----------------
-    bool cancel(string pnr) {
-        for (int i = 0; i < bookings.size(); i++) {
-            if (bookings[i].pnr == pnr) {
-                bookings.erase(bookings.begin() + i);
-                return saveBookings();
+    // False if another process holds the lock
+    bool acquire(const string &path) {
+#ifdef _WIN32
+        // opened without sharing, so a second open fails while this one lives
+        file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_ALWAYS,
+                           FILE_ATTRIBUTE_NORMAL, NULL);
+        return file != INVALID_HANDLE_VALUE;
+#else
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0) return false;
+        if (flock(fd, LOCK_EX | LOCK_NB) == 0) return true;
+        ::close(fd);
+        fd = -1;
+        return false;
+#endif
+    }
+};
+
+// -------------------- CSV READER --------------------
+// Splits a mapped buffer into rows of trimmed string_view fields that point
+// straight into the mapping, reusing one field vector for every row.
+struct CsvReader {
+    const char *cur;
+    const char *end;
+    string_view row;    // text of the row next() last returned
+
+    CsvReader(const char *data, size_t size) {
+        cur = data;
+        end = data + size;
+    }
+
+    static string_view trim(const char *a, const char *b) {
+        while (a < b && (*a == ' ' || *a == '\t' || *a == '\r')) a++;
+        while (b > a && (b[-1] == ' ' || b[-1] == '\t' || b[-1] == '\r')) b--;
+        return string_view(a, b - a);
+    }
+
+    // Next non-blank row; false at end of buffer
+    bool next(vector<string_view> &fields, char d) {
+        while (cur < end) {
+            const char *eol = (const char *)memchr(cur, '\n', end - cur);
+            if (eol == NULL) eol = end;
+            const char *line = cur;
+            cur = (eol == end) ? end : eol + 1;
+
+            row = trim(line, eol);
+            if (row.empty()) continue;
+
+            fields.clear();
+            const char *start = line;
+            for (const char *c = line; c < eol; c++) {
+                if (*c == d) {
+                    fields.push_back(trim(start, c));
+                    start = c + 1;
+                }
             }
+            fields.push_back(trim(start, eol));
+            return true;
         }
         return false;
     }
+
+    // Number of lines, used to reserve storage before parsing
+    size_t countLines() {
+        size_t n = 0;
+        const char *c = cur;
+        while (c < end && (c = (const char *)memchr(c, '\n', end - c)) != NULL) {
+            n++;
+            c++;
+        }
+        return n + 1;
+    }
 };
 
-// -------------------- MAIN --------------------
-int main() {
-    Database db;
-    db.loadTrains();
-    db.loadBookings();
+// Integer value of a field; stops at the first non-digit like atoi
+static int toInt(string_view s) {
+    int v = 0;
+    bool neg = !s.empty() && s[0] == '-';
+    for (size_t i = neg ? 1 : 0; i < s.size() && s[i] >= '0' && s[i] <= '9'; i++) {
+        v = v * 10 + (s[i] - '0');
+    }
+    return neg ? -v : v;
+}
 
-    cout << "Database Loaded Successfully.\n";
-    return 0;
+// -------------------- BINARY SNAPSHOT --------------------
+// Layout: SnapshotHeader, recordCount fixed-width records, string table.
+// Records refer to strings by (offset, length) into the table, and equal
+// strings are stored once. The header carries the size and mtime of the
+// CSV the snapshot was made from, so a hand-edited or imported CSV simply
+// makes the snapshot stale and the CSV is parsed instead.
+static const char SNAPSHOT_MAGIC[8] = {'T', 'R', 'S', 'N', 'A', 'P', '\0', '\0'};
+static const unsigned int SNAPSHOT_VERSION = 6;
+
+struct SnapshotHeader {
+    char magic[8];
+    unsigned int version;
+    unsigned int recordSize;
+    long long sourceSize;
+    long long sourceTime;
+    unsigned long long recordCount;
+    unsigned long long stringBytes;
+};
+
+struct StrRef {
+    unsigned int offset;
+    unsigned int length;
+};
+
+struct TrainRecord {
+    StrRef trainNo, trainName, from, to, stop;
+    int arr, dep;
+    unsigned int classes;
+    unsigned int pad;
+};
+
+struct BookingRecord {
+    StrRef pnr, name, trainNo, from, to;
+    int age;
+    int seatNo;
+    int fare;
+    int classType;
+    int date;
+    int pad;
+};
+
+// Size and modification time of a file; false if it does not exist
+static bool fileStamp(const string &path, long long &size, long long &mtime) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return false;
+    size = st.st_size;
+    mtime = st.st_mtime;
+    return true;
+}
+
+struct SnapshotWriter {
+    string records;
+    string strings;
+    unordered_map<string, StrRef> seen;
+    unsigned long long count;
+
+    SnapshotWriter() {
+        count = 0;
+    }
+
+    StrRef str(const string &s) {
+        unordered_map<string, StrRef>::iterator it = seen.find(s);
+        if (it != seen.end()) return it->second;
+
+        StrRef r;
+        r.offset = strings.size();
+        r.length = s.size();
+        strings += s;
+        seen[s] = r;
+        return r;
+    }
+
+    void add(const void *record, size_t size) {
+        records.append((const char *)record, size);
+        count++;
+    }
+
+    // Stamped with the CSV at source, which must already be written
+    bool save(const string &path, const string &source, unsigned int recordSize) {
+        SnapshotHeader h;
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, SNAPSHOT_MAGIC, 8);
+        h.version = SNAPSHOT_VERSION;
+        h.recordSize = recordSize;
+        if (!fileStamp(source, h.sourceSize, h.sourceTime)) return false;
+        h.recordCount = count;
+        h.stringBytes = strings.size();
+
+        string data((const char *)&h, sizeof(h));
+        data += records;
+        data += strings;
+        return replaceFile(path, data);
+    }
+};
+
+struct SnapshotReader {
+    MappedFile file;
+    SnapshotHeader header;
+    const char *records;
+    const char *strings;
+
+    SnapshotReader() {
+        records = NULL;
+        strings = NULL;
+    }
+
+    // False if missing, damaged, another version or older than source
+    bool open(const string &path, const string &source, unsigned int recordSize) {
+        long long size, mtime;
+        if (!fileStamp(source, size, mtime)) return false;
+        if (!file.open(path) || file.size < sizeof(header)) return false;
+
+        memcpy(&header, file.data, sizeof(header));
+        if (memcmp(header.magic, SNAPSHOT_MAGIC, 8) != 0) return false;
+        if (header.version != SNAPSHOT_VERSION || header.recordSize != recordSize) return false;
+        if (header.sourceSize != size || header.sourceTime != mtime) return false;
+        if (sizeof(header) + header.recordCount * recordSize + header.stringBytes != file.size) return false;
+
+        records = file.data + sizeof(header);
+        strings = records + header.recordCount * recordSize;
+        return true;
+    }
+
+    void record(unsigned long long i, void *out) {
+        memcpy(out, records + i * header.recordSize, header.recordSize);
+    }
+
+    string_view str(StrRef r) {
+        if ((unsigned long long)r.offset + r.length > header.stringBytes) return string_view();
+        return string_view(strings + r.offset, r.length);
+    }
+};
+
+// -------------------- NAME SCANNER --------------------
+// Strings (one per train) lower-cased into one buffer, each followed by
+// "\n", so a search is a single pass over contiguous memory. Candidate
+// positions are found by matching the first and last key byte 32 (AVX2) or
+// 16 (SSE2) positions at a time, and only those are compared in full.
+struct NameScanner {
+    static const int PAD = 64;   // zero bytes kept past the end for wide loads
+
+    string text;
+    size_t length;               // text.size() without the padding
+    vector<size_t> start;        // offset of each string, in train order
+
+    NameScanner() {
+        clear();
+    }
+
+    void clear() {
+        text.assign(PAD, '\0');
+        length = 0;
+        start.clear();
+    }
+
+    static char lower(char c) {
+        return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+    }
+
+    void add(string_view name) {
+        text.resize(length);
+        start.push_back(length);
+        for (int i = 0; i < name.size(); i++) {
+            text.push_back(lower(name[i]));
+        }
+        text.push_back('\n');
+        length = text.size();
+        text.append(PAD, '\0');
+    }
+
+    // Which string a buffer offset falls in
+    int owner(size_t pos) const {
+        return upper_bound(start.begin(), start.end(), pos) - start.begin() - 1;
+    }
+
+    // The i-th string, without its "\n"
+    string_view entry(int i) const {
+        size_t end = i + 1 < start.size() ? start[i + 1] : length;
+        return string_view(text.data() + start[i], end - start[i] - 1);
+    }
+
+    // First pos in [i, last] with text[pos] == a and text[pos + k - 1] == b
+    size_t candidate(size_t i, size_t last, size_t k, char a, char b) const {
+        const char *s = text.data();
+#if defined(__AVX2__)
+        __m256i wa = _mm256_set1_epi8(a);
+        __m256i wb = _mm256_set1_epi8(b);
+        for (; i + 32 <= last + 1; i += 32) {
+            __m256i x = _mm256_cmpeq_epi8(wa, _mm256_loadu_si256((const __m256i *)(s + i)));
+            __m256i y = _mm256_cmpeq_epi8(wb, _mm256_loadu_si256((const __m256i *)(s + i + k - 1)));
+            unsigned int mask = _mm256_movemask_epi8(_mm256_and_si256(x, y));
+            if (mask != 0) return i + __builtin_ctz(mask);
+        }
+#elif defined(__SSE2__)
+        __m128i wa = _mm_set1_epi8(a);
+        __m128i wb = _mm_set1_epi8(b);
+        for (; i + 16 <= last + 1; i += 16) {
+            __m128i x = _mm_cmpeq_epi8(wa, _mm_loadu_si128((const __m128i *)(s + i)));
+            __m128i y = _mm_cmpeq_epi8(wb, _mm_loadu_si128((const __m128i *)(s + i + k - 1)));
+            unsigned int mask = _mm_movemask_epi8(_mm_and_si128(x, y));
+            if (mask != 0) return i + __builtin_ctz(mask);
+        }
+#endif
+        for (; i <= last; i++) {
+            if (s[i] == a && s[i + k - 1] == b) return i;
+        }
+        return string::npos;
+    }
+
+    // Indices of the strings containing key (case-insensitive), ascending
+    vector<int> find(string_view key) const {
+        vector<int> result;
+        string low;
+        for (int i = 0; i < key.size(); i++) {
+            if (key[i] == '\n') return result;
+            low.push_back(lower(key[i]));
+        }
+
+        if (low.empty()) {
+            for (int i = 0; i < start.size(); i++) result.push_back(i);
+            return result;
+        }
+        if (low.size() > length) return result;
+
+        size_t k = low.size();
+        size_t last = length - k;
+        size_t i = 0;
+        while (i <= last) {
+            size_t pos = candidate(i, last, k, low[0], low[k - 1]);
+            if (pos == string::npos) break;
+
+            if (memcmp(text.data() + pos, low.data(), k) == 0) {
+                int t = owner(pos);
+                result.push_back(t);
+                // one hit per name is enough, go on from the next one
+                if (t + 1 >= start.size()) break;
+                i = start[t + 1];
+            } else {
+                i = pos + 1;
+            }
+        }
+        return result;
+    }
+};
+
+// -------------------- TRIGRAM INDEX --------------------
+// Inverted index from every 3-byte lower-cased gram of a train's name and
+// stations to the (ascending) train positions containing it. A key of 3 or
+// more bytes only looks at trains present in all of its grams' posting
+// lists; shorter keys have no gram and are scanned for in every train.
+struct TrigramIndex {
+    NameScanner docs;                            // "name\nfrom\nto" per train
+    unordered_map<unsigned int, vector<int> > postings;
+
+    void clear() {
+        docs.clear();
+        postings.clear();
+    }
+
+    static unsigned int gram(const char *s) {
+        return ((unsigned char)s[0] << 16) | ((unsigned char)s[1] << 8) | (unsigned char)s[2];
+    }
+
+    void add(string_view name, string_view from, string_view to) {
+        int t = docs.start.size();
+        string doc;
+        doc.reserve(name.size() + from.size() + to.size() + 2);
+        for (int i = 0; i < name.size(); i++) doc.push_back(NameScanner::lower(name[i]));
+        doc.push_back('\n');
+        for (int i = 0; i < from.size(); i++) doc.push_back(NameScanner::lower(from[i]));
+        doc.push_back('\n');
+        for (int i = 0; i < to.size(); i++) doc.push_back(NameScanner::lower(to[i]));
+
+        for (int i = 0; i + 3 <= (int)doc.size(); i++) {
+            vector<int> &list = postings[gram(doc.data() + i)];
+            // trains are added in order, so a repeat can only be at the back
+            if (list.empty() || list.back() != t) list.push_back(t);
+        }
+        docs.add(doc);
+    }
+
+    // Positions of the trains whose name or a station contains key
+    vector<int> find(string_view key) const {
+        vector<int> result;
+        string low;
+        for (int i = 0; i < key.size(); i++) {
+            if (key[i] == '\n') return result;
+            low.push_back(NameScanner::lower(key[i]));
+        }
+
+        if (low.size() < 3) return docs.find(low);
+
+        // collect the posting lists, shortest first
+        vector<const vector<int> *> lists;
+        for (int i = 0; i + 3 <= (int)low.size(); i++) {
+            unordered_map<unsigned int, vector<int> >::const_iterator it = postings.find(gram(low.data() + i));
+            if (it == postings.end()) return result;
+            lists.push_back(&it->second);
+        }
+        sort(lists.begin(), lists.end(),
+             [](const vector<int> *a, const vector<int> *b) { return a->size() < b->size(); });
+
+        vector<int> candidates = *lists[0];
+        for (int i = 1; i < lists.size() && !candidates.empty(); i++) {
+            if (lists[i] == lists[i - 1]) continue;
+            const vector<int> &other = *lists[i];
+            vector<int>::const_iterator pos = other.begin();
+            int kept = 0;
+            for (int j = 0; j < candidates.size(); j++) {
+                pos = lower_bound(pos, other.end(), candidates[j]);
+                if (pos == other.end()) break;
+                if (*pos == candidates[j]) candidates[kept++] = candidates[j];
+            }
+            candidates.resize(kept);
+        }
+
+        // grams can match out of order or across fields, so confirm each one
+        for (int i = 0; i < candidates.size(); i++) {
+            if (docs.entry(candidates[i]).find(low) != string_view::npos) result.push_back(candidates[i]);
+        }
+        return result;
+    }
+};
+
+// -------------------- PNR GENERATOR --------------------
+// PNRs are 10 digits: FIRST + permute(seq) for a running sequence number.
+// permute() is a Feistel network over 34 bits, cycle-walked down to
+// [0, SPACE), so it is a bijection: distinct sequence numbers can never
+// give the same PNR and nothing has to be looked up. Older 6-digit PNRs
+// are shorter and so never clash either.
+//
+// Each program draws from its own range of sequence numbers (the service
+// the lower half, the GUI the upper), so their PNRs can't collide even
+// though each keeps its own pnr file.
+struct PnrGenerator {
+    static const unsigned long long FIRST = 1000000000ULL;
+    static const unsigned long long SPACE = 9000000000ULL;
+    static const int HALF_BITS = 17;
+    static const unsigned int HALF_MASK = (1u << HALF_BITS) - 1;
+
+    atomic<unsigned long long> next;
+    unsigned long long low;     // this program's sequence numbers: [low, high)
+    unsigned long long high;
+
+    PnrGenerator() {
+        useRange(0, SPACE / 2);
+    }
+
+    // Call before any thread uses the generator
+    void useRange(unsigned long long from, unsigned long long to) {
+        low = from;
+        high = to;
+        next = low;
+    }
+
+    unsigned int round(unsigned int half, int r) {
+        static const unsigned int keys[4] = {0x9E3779B9u, 0x7F4A7C15u, 0x85EBCA6Bu, 0xC2B2AE35u};
+        unsigned int x = (half ^ keys[r]) * 0x2C1B3C6Du;
+        x ^= x >> 15;
+        return x & HALF_MASK;
+    }
+
+    unsigned long long feistel(unsigned long long v) {
+        unsigned int l = (unsigned int)(v >> HALF_BITS) & HALF_MASK;
+        unsigned int r = (unsigned int)v & HALF_MASK;
+        for (int i = 0; i < 4; i++) {
+            unsigned int t = l ^ round(r, i);
+            l = r;
+            r = t;
+        }
+        return ((unsigned long long)l << HALF_BITS) | r;
+    }
+
+    unsigned long long unfeistel(unsigned long long v) {
+        unsigned int l = (unsigned int)(v >> HALF_BITS) & HALF_MASK;
+        unsigned int r = (unsigned int)v & HALF_MASK;
+        for (int i = 3; i >= 0; i--) {
+            unsigned int t = r ^ round(l, i);
+            r = l;
+            l = t;
+        }
+        return ((unsigned long long)l << HALF_BITS) | r;
+    }
+
+    // Cycle-walk: 2^34 is under 2 * SPACE, so this takes ~1.9 rounds on average
+    unsigned long long permute(unsigned long long seq) {
+        do { seq = feistel(seq); } while (seq >= SPACE);
+        return seq;
+    }
+
+    unsigned long long unpermute(unsigned long long v) {
+        do { v = unfeistel(v); } while (v >= SPACE);
+        return v;
+    }
+
+    // Thread-safe; returns "" once the range is used up
+    string make() {
+        unsigned long long seq = next.fetch_add(1);
+        if (seq >= high) return "";
+        return to_string(FIRST + permute(seq));
+    }
+
+    // Move the sequence past n (never backwards). Numbers from the other
+    // program's range are ignored.
+    void skipTo(unsigned long long n) {
+        if (n <= low || n > high) return;
+        unsigned long long cur = next.load();
+        while (cur < n && !next.compare_exchange_weak(cur, n)) {
+        }
+    }
+
+    // Move the sequence past a PNR read back from disk
+    void observe(const string &pnr) {
+        if (pnr.size() != 10 || pnr[0] == '0') return;
+        for (int i = 0; i < 10; i++) {
+            if (pnr[i] < '0' || pnr[i] > '9') return;
+        }
+        skipTo(unpermute(strtoull(pnr.c_str(), NULL, 10) - FIRST) + 1);
+    }
+};
+
+// -------------------- BOOKING STORE --------------------
+// Bookings are kept column by column, so scans such as counts, revenue
+// and occupancy only touch the columns they read. Rows are slots: a
+// cancelled slot is tombstoned (live = 0) and reused through freeSlots,
+// so cancelling never moves another booking.
+struct BookingStore {
+    vector<string> pnr;
+    vector<string> name;
+    vector<int> age;
+    vector<int> trainNo;
+    vector<unsigned char> classType;
+    vector<int> seatNo;
+    vector<int> fare;
+    vector<int> from;
+    vector<int> to;
+    vector<int> date;
+    vector<char> live;
+
+    vector<int> freeSlots;
+    int liveCount;
+
+    // pnr -> slot; a multimap because older files may repeat a PNR
+    unordered_multimap<string, int> pnrIndex;
+
+    BookingStore() {
+        liveCount = 0;
+    }
+
+    int slots() const {
+        return live.size();
+    }
+
+    void clear() {
+        pnr.clear();
+        name.clear();
+        age.clear();
+        trainNo.clear();
+        classType.clear();
+        seatNo.clear();
+        fare.clear();
+        from.clear();
+        to.clear();
+        date.clear();
+        live.clear();
+        freeSlots.clear();
+        pnrIndex.clear();
+        liveCount = 0;
+    }
+
+    void reserve(size_t n) {
+        pnr.reserve(n);
+        name.reserve(n);
+        age.reserve(n);
+        trainNo.reserve(n);
+        classType.reserve(n);
+        seatNo.reserve(n);
+        fare.reserve(n);
+        from.reserve(n);
+        to.reserve(n);
+        date.reserve(n);
+        live.reserve(n);
+        pnrIndex.reserve(n);
+    }
+
+    // Free slot if there is one, else a new row at the end
+    int insert(const Booking &b) {
+        int slot;
+        if (!freeSlots.empty()) {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        } else {
+            slot = live.size();
+            pnr.push_back("");
+            name.push_back("");
+            age.push_back(0);
+            trainNo.push_back(-1);
+            classType.push_back(0);
+            seatNo.push_back(0);
+            fare.push_back(0);
+            from.push_back(-1);
+            to.push_back(-1);
+            date.push_back(-1);
+            live.push_back(0);
+        }
+
+        pnr[slot] = b.pnr;
+        name[slot] = b.name;
+        age[slot] = b.age;
+        trainNo[slot] = b.trainNo;
+        classType[slot] = b.classType;
+        seatNo[slot] = b.seatNo;
+        fare[slot] = b.fare;
+        from[slot] = b.from;
+        to[slot] = b.to;
+        date[slot] = b.date;
+        live[slot] = 1;
+        liveCount++;
+
+        pnrIndex.insert(make_pair(b.pnr, slot));
+        return slot;
+    }
+
+    Booking get(int slot) const {
+        Booking b;
+        b.pnr = pnr[slot];
+        b.name = name[slot];
+        b.age = age[slot];
+        b.trainNo = trainNo[slot];
+        b.classType = (TravelClass)classType[slot];
+        b.seatNo = seatNo[slot];
+        b.fare = fare[slot];
+        b.from = from[slot];
+        b.to = to[slot];
+        b.date = date[slot];
+        return b;
+    }
+
+    // A slot holding this PNR, or -1
+    int find(const string &p) const {
+        unordered_multimap<string, int>::const_iterator it = pnrIndex.find(p);
+        if (it == pnrIndex.end()) return -1;
+        return it->second;
+    }
+
+    void remove(int slot) {
+        pair<unordered_multimap<string, int>::iterator,
+             unordered_multimap<string, int>::iterator> range = pnrIndex.equal_range(pnr[slot]);
+        for (unordered_multimap<string, int>::iterator it = range.first; it != range.second; it++) {
+            if (it->second == slot) {
+                pnrIndex.erase(it);
+                break;
+            }
+        }
+
+        pnr[slot] = string();
+        name[slot] = string();
+        trainNo[slot] = -1;
+        live[slot] = 0;
+        liveCount--;
+        freeSlots.push_back(slot);
+    }
+};
+
+// -------------------- JOURNAL UNDO --------------------
+// What a queued journal record changed, so it can be taken back if its
+// write fails: the booking it added, or the one it cancelled. A cancelled
+// booking's seat stays held until the cancel is on disk, so nobody else
+// can take it before then.
+struct JournalUndo {
+    bool cancelled;
+    Booking booking;
+
+    JournalUndo(bool wasCancel, const Booking &b) {
+        cancelled = wasCancel;
+        booking = b;
+    }
+};
+
+// -------------------- BOOKING SHARD --------------------
+// Bookings are split by a hash of the train number. A shard owns the
+// bookings and seat maps of its trains, its own bookings.<k>.csv / .bin /
+// .journal and a lock, so bookings on trains in different shards are
+// written in parallel. SHARD_COUNT is in bookingfiles.h.
+
+struct BookingShard {
+    BookingStore bookings;
+
+    // seat occupancy per (journey date, trainNo id), one SeatMap per class.
+    // Partitions appear on first use and go when their date is archived.
+    unordered_map<unsigned long long, vector<SeatMap> > seatMaps;
+
+    string bookingFile;
+    string journalFile;
+    string bookingSnapshot;
+
+    // CSV rows that don't parse (e.g. a class code this build doesn't know),
+    // moved to the rejects file when the CSV is next rewritten
+    vector<string> rejected;
+
+    // Append-only log of add/cancel records since the last snapshot.
+    // Records wait in `pending` (with their undo entries) for the
+    // group-commit thread. `queued` counts the records ever queued and
+    // `settled` those ever dealt with: on disk, or undone after a failed
+    // write, in which case their seq range is kept in `lost`. A caller is
+    // done once settled reaches its ticket.
+    AppendFile journal;
+    long long journalBytes;         // journal size up to the last synced batch (ioLock)
+    int journalRecords;
+    string pending;
+    vector<JournalUndo> pendingUndo;
+    unsigned long long queued;
+    unsigned long long settled;
+    vector<pair<unsigned long long, unsigned long long> > lost;
+    bool failed;                    // the journal's tail is in doubt: nothing is
+                                    // written until a fold or truncate works
+    mutex commitLock;               // guards the six above
+    condition_variable committed;
+    mutex ioLock;                   // held while writing or replacing the journal
+
+    // shared to read, exclusive to write
+    mutable shared_mutex lock;
+
+    BookingShard() {
+        journalBytes = 0;
+        journalRecords = 0;
+        queued = 0;
+        settled = 0;
+        failed = false;
+    }
+};
+
+// A journal record's place in its shard's commit order. seq 0 means
+// there is nothing to wait for.
+struct CommitTicket {
+    int shard;
+    unsigned long long seq;
+
+    CommitTicket() {
+        shard = 0;
+        seq = 0;
+    }
+};
+
+// FNV-1a of the train number itself: pool ids depend on load order, but a
+// train has to land in the same shard files on every start
+static int shardOf(string_view trainNo) {
+    unsigned int h = 2166136261u;
+    for (size_t i = 0; i < trainNo.size(); i++) {
+        h = (h ^ (unsigned char)trainNo[i]) * 16777619u;
+    }
+    return h % SHARD_COUNT;
+}
+
+// -------------------- DATABASE CLASS --------------------
+// Thread safety: `rw` guards the timetable and the string pool, and each
+// booking shard's lock guards that shard. Queries and bookings take rw
+// shared and then the one shard they touch (shared to read, exclusive to
+// write), never two shards at once. Loads, archiving all shards and
+// compaction take rw exclusively, which keeps every shard still as well. Locked methods never
+// call each other (the locks aren't recursive); internal helpers assume the
+// caller holds them. Results are copies, except findByNumber()'s pointer,
+// which a later loadTrains() may invalidate.
+class Database {
+public:
+    vector<Train> trains;
+
+    BookingShard shards[SHARD_COUNT];
+
+    // Interned train numbers, names and stations. Never cleared, so ids
+    // held by bookings stay valid across a timetable reload.
+    StringPool pool;
+
+    // pool id of a trainNo -> position in trains (-1 if none), rebuilt by loadTrains()
+    vector<int> trainIndex;
+
+    // name and station trigrams for search()
+    TrigramIndex grams;
+
+    // (from, to) station ids -> positions in trains, ordered by departure
+    unordered_map<unsigned long long, vector<int> > routes;
+
+    // positions in trains with a known departure, ascending by it
+    vector<int> departures;
+
+    // Every train's calls back to back: train i owns
+    // stops[stopStart[i] .. stopStart[i + 1]), in running order
+    vector<Stop> stops;
+    vector<int> stopStart;
+
+    // The same calls grouped by station id: station s is called at by
+    // stationCalls[callStart[s] .. callStart[s + 1]) as (train, stop index),
+    // ascending by train and then by stop
+    vector<int> callStart;
+    vector<pair<int, int> > stationCalls;
+
+    int seatCapacity[CLASS_COUNT];
+    int fares[CLASS_COUNT];
+
+    string trainFile;
+    string stopFile;
+    string trainSnapshot;
+    string pnrFile;
+
+    // the single-file store from before sharding, imported once
+    string bookingFile;
+    string journalFile;
+    string bookingSnapshot;
+    string shardMarker;
+
+    string archiveFile;
+    string rejectFile;
+
+    // How many days ahead a new booking may be made
+    int bookingHorizon;
+
+    PnrGenerator pnrGen;
+
+    // Journal records a shard takes before it is folded into its files
+    int compactEvery;
+
+    // Group commit: queued journal records are written and synced together
+    // this often. Read by the writer thread, so set it before loadBookings().
+    int commitMicros;
+    thread writer;
+    atomic<bool> writerRunning;
+    mutex writerLock;
+    condition_variable writerWake;
+    bool workQueued;
+    bool stopping;
+
+    // see the class comment
+    mutable shared_mutex rw;
+
+    // shards fold on their own, but share pnr.seq, bookings.rejects and
+    // bookings.archive
+    mutex pnrFileLock;
+    mutex rejectFileLock;
+    mutex archiveFileLock;
+
+    Database() {
+        trainFile = "trains.csv";
+        stopFile = "stops.csv";
+        bookingFile = "bookings.csv";
+        journalFile = "bookings.journal";
+        trainSnapshot = "trains.bin";
+        bookingSnapshot = "bookings.bin";
+        shardMarker = SHARD_MARKER;
+        archiveFile = "bookings.archive";
+        rejectFile = "bookings.rejects";
+        bookingHorizon = 120;
+        pnrFile = "pnr.seq";
+
+        for (int k = 0; k < SHARD_COUNT; k++) {
+            string base = "bookings." + to_string(k);
+            shards[k].bookingFile = base + ".csv";
+            shards[k].journalFile = base + ".journal";
+            shards[k].bookingSnapshot = base + ".bin";
+        }
+        compactEvery = 1000;
+        commitMicros = 2000;
+        writerRunning = false;
+        workQueued = false;
+        stopping = false;
+
+        seatCapacity[CLASS_1A] = 20;
+        seatCapacity[CLASS_2A] = 40;
+        seatCapacity[CLASS_3A] = 60;
+        seatCapacity[CLASS_3E] = 70;
+        seatCapacity[CLASS_SL] = 120;
+        seatCapacity[CLASS_CC] = 80;
+        seatCapacity[CLASS_2S] = 100;
+
+        fares[CLASS_1A] = 2000;
+        fares[CLASS_2A] = 1500;
+        fares[CLASS_3A] = 1100;
+        fares[CLASS_3E] = 900;
+        fares[CLASS_SL] = 400;
+        fares[CLASS_CC] = 700;
+        fares[CLASS_2S] = 300;
+    }
+
+    // Whatever is still queued is written before the writer stops
+    ~Database() {
+        if (!writer.joinable()) return;
+        {
+            lock_guard<mutex> lk(writerLock);
+            stopping = true;
+        }
+        writerWake.notify_one();
+        writer.join();
+    }
+
+    // ---------------- LOAD TRAINS ----------------
+    // Uses trains.bin when it matches trains.csv, else parses the CSV and
+    // refreshes trains.bin for the next start
+    bool loadTrains() {
+        unique_lock<shared_mutex> guard(rw);
+        trains.clear();
+        trainIndex.clear();
+        grams.clear();
+        routes.clear();
+        departures.clear();
+
+        if (!loadTrainSnapshot() && !loadTrainCsv()) return false;
+        loadStops();
+        buildDepartureIndex();
+
+        for (int k = 0; k < SHARD_COUNT; k++) {
+            if (shards[k].bookings.liveCount > 0) rebuildSeatMaps(shards[k]);
+        }
+        return true;
+    }
+
+    bool loadTrainCsv() {
+        MappedFile file;
+        if (!file.open(trainFile)) return false;
+
+        CsvReader csv(file.data, file.size);
+        trains.reserve(csv.countLines());
+
+        vector<string_view> p;
+        csv.next(p, ',');   // header
+
+        while (csv.next(p, ',')) {
+            if (p.size() < 8) continue;
+
+            Train t;
+            t.trainNo = pool.intern(p[0]);
+            t.trainName = pool.intern(p[1]);
+            t.from = pool.intern(p[2]);
+            t.to = pool.intern(p[3]);
+            t.arr = parseTime(p[4]);
+            t.dep = parseTime(p[5]);
+            t.stop = p[6];
+            t.classes = parseClassList(p[7]);
+
+            addTrain(t);
+        }
+        file.close();
+
+        saveTrainSnapshot();
+        return true;
+    }
+
+    // ---------------- LOAD STOPS ----------------
+    // stops.csv lists every call as "Train No,Station,Arrival,Departure",
+    // in running order per train. Trains it doesn't mention (or all of them,
+    // without the file) get two calls made from their From/To columns.
+    void loadStops() {
+        stops.clear();
+        stopStart.clear();
+        callStart.clear();
+        stationCalls.clear();
+
+        // (train position, call) in file order
+        vector<pair<int, Stop> > rows;
+
+        MappedFile file;
+        if (file.open(stopFile)) {
+            CsvReader csv(file.data, file.size);
+            rows.reserve(csv.countLines());
+
+            vector<string_view> p;
+            csv.next(p, ',');   // header
+
+            while (csv.next(p, ',')) {
+                if (p.size() < 4) continue;
+
+                int id = pool.find(p[0]);
+                if (id < 0 || id >= trainIndex.size() || trainIndex[id] < 0) continue;
+
+                Stop s;
+                s.station = pool.intern(p[1]);
+                s.arr = parseTime(p[2]);
+                s.dep = parseTime(p[3]);
+                rows.push_back(make_pair(trainIndex[id], s));
+            }
+            file.close();
+        }
+
+        stable_sort(rows.begin(), rows.end(),
+                    [](const pair<int, Stop> &a, const pair<int, Stop> &b) { return a.first < b.first; });
+
+        stops.reserve(rows.size() + 2 * trains.size());
+        stopStart.reserve(trains.size() + 1);
+
+        int r = 0;
+        for (int i = 0; i < trains.size(); i++) {
+            stopStart.push_back(stops.size());
+
+            if (r < rows.size() && rows[r].first == i) {
+                while (r < rows.size() && rows[r].first == i) {
+                    stops.push_back(rows[r].second);
+                    r++;
+                }
+                continue;
+            }
+
+            Stop origin, end;
+            origin.station = trains[i].from;
+            origin.arr = -1;
+            origin.dep = trains[i].dep;
+            end.station = trains[i].to;
+            end.arr = trains[i].arr;
+            end.dep = -1;
+            stops.push_back(origin);
+            stops.push_back(end);
+        }
+        stopStart.push_back(stops.size());
+
+        // group the calls by station: count, prefix sum, then fill in train order
+        callStart.assign(pool.size() + 1, 0);
+        for (int i = 0; i < stops.size(); i++) {
+            callStart[stops[i].station + 1]++;
+        }
+        for (int s = 0; s < pool.size(); s++) {
+            callStart[s + 1] += callStart[s];
+        }
+
+        stationCalls.resize(stops.size());
+        vector<int> fill(callStart.begin(), callStart.end() - 1);
+        for (int i = 0; i < trains.size(); i++) {
+            for (int k = 0; k < stopCount(i); k++) {
+                int s = stops[stopStart[i] + k].station;
+                stationCalls[fill[s]++] = make_pair(i, k);
+            }
+        }
+    }
+
+    // ---------------- DEPARTURE INDEX ----------------
+    void buildDepartureIndex() {
+        departures.clear();
+        for (int i = 0; i < trains.size(); i++) {
+            if (trains[i].dep >= 0) departures.push_back(i);
+        }
+        stable_sort(departures.begin(), departures.end(),
+                    [this](int a, int b) { return trains[a].dep < trains[b].dep; });
+    }
+
+    int stopCount(int train) const {
+        return stopStart[train + 1] - stopStart[train];
+    }
+
+    const Stop &stopOf(int train, int k) const {
+        return stops[stopStart[train] + k];
+    }
+
+    // "1A 2A CC" -> class bitmask; unknown codes are ignored
+    unsigned int parseClassList(string_view list) {
+        unsigned int mask = 0;
+        vector<string_view> codes;
+        CsvReader csv(list.data(), list.size());
+        while (csv.next(codes, ' ')) {
+            for (int i = 0; i < codes.size(); i++) {
+                TravelClass c = classFromCode(codes[i]);
+                if (c != CLASS_COUNT) mask |= classBit(c);
+            }
+        }
+        return mask;
+    }
+
+    void addTrain(const Train &t) {
+        grams.add(pool.str(t.trainName), pool.str(t.from), pool.str(t.to));
+        if (t.trainNo >= trainIndex.size()) {
+            trainIndex.resize(t.trainNo + 1, -1);
+        }
+        // keep the first row for a duplicated number, like the old scan did
+        if (trainIndex[t.trainNo] < 0) {
+            trainIndex[t.trainNo] = trains.size();
+        }
+
+        vector<int> &route = routes[routeKey(t.from, t.to)];
+        route.insert(upper_bound(route.begin(), route.end(), t.dep,
+                                 [this](int dep, int i) { return dep < trains[i].dep; }),
+                     trains.size());
+
+        trains.push_back(t);
+    }
+
+    static unsigned long long routeKey(int from, int to) {
+        return ((unsigned long long)(unsigned int)from << 32) | (unsigned int)to;
+    }
+
+    // ---------------- TRAIN SNAPSHOT ----------------
+    bool loadTrainSnapshot() {
+        SnapshotReader snap;
+        if (!snap.open(trainSnapshot, trainFile, sizeof(TrainRecord))) return false;
+
+        trains.reserve(snap.header.recordCount);
+
+        for (unsigned long long i = 0; i < snap.header.recordCount; i++) {
+            TrainRecord r;
+            snap.record(i, &r);
+
+            Train t;
+            t.trainNo = pool.intern(snap.str(r.trainNo));
+            t.trainName = pool.intern(snap.str(r.trainName));
+            t.from = pool.intern(snap.str(r.from));
+            t.to = pool.intern(snap.str(r.to));
+            t.arr = r.arr;
+            t.dep = r.dep;
+            t.stop = snap.str(r.stop);
+            t.classes = r.classes;
+            addTrain(t);
+        }
+        return true;
+    }
+
+    bool saveTrainSnapshot() {
+        SnapshotWriter snap;
+        for (int i = 0; i < trains.size(); i++) {
+            Train &t = trains[i];
+
+            TrainRecord r;
+            r.trainNo = snap.str(pool.str(t.trainNo));
+            r.trainName = snap.str(pool.str(t.trainName));
+            r.from = snap.str(pool.str(t.from));
+            r.to = snap.str(pool.str(t.to));
+            r.arr = t.arr;
+            r.dep = t.dep;
+            r.stop = snap.str(t.stop);
+            r.classes = t.classes;
+            r.pad = 0;
+            snap.add(&r, sizeof(r));
+        }
+        return snap.save(trainSnapshot, trainFile, sizeof(TrainRecord));
+    }
+
+    // ---------------- LOAD BOOKINGS ----------------
+    // Every shard reads its own files. A tree that only has the single
+    // bookings.csv / .bin / .journal from before sharding is imported from
+    // those once and written straight out as shards; the shard marker goes
+    // last, so an import that fails part way is redone from bookings.csv on
+    // the next start. Starts the group-commit writer.
+    bool loadBookings() {
+        unique_lock<shared_mutex> guard(rw);
+        for (int k = 0; k < SHARD_COUNT; k++) {
+            // anything still queued belongs in the journal about to be read
+            commitShard(shards[k], true);
+            shards[k].bookings.clear();
+            shards[k].seatMaps.clear();
+            shards[k].rejected.clear();
+        }
+        loadPnrSequence();
+
+        if (!writerRunning) {
+            writerRunning = true;
+            writer = thread(&Database::commitLoop, this);
+        }
+
+        int split = shardsOnDisk();
+        if (split < 0) {
+            loadBookingFiles(bookingFile, bookingSnapshot, journalFile, NULL);
+            for (int k = 0; k < SHARD_COUNT; k++) {
+                if (!foldJournal(shards[k])) {
+                    cerr << "Cannot write " << shards[k].bookingFile << "\n";
+                    return false;
+                }
+            }
+            if (!replaceFile(shardMarker, to_string(SHARD_COUNT) + "\n")) {
+                cerr << "Cannot write " << shardMarker << "\n";
+                return false;
+            }
+            return true;
+        }
+        if (split != SHARD_COUNT) {
+            // trains would be looked for in the wrong files
+            cerr << "The bookings were split into " << split << " shards, this build uses " << SHARD_COUNT << "\n";
+            return false;
+        }
+
+        for (int k = 0; k < SHARD_COUNT; k++) {
+            BookingShard &s = shards[k];
+            s.journalRecords = loadBookingFiles(s.bookingFile, s.bookingSnapshot, s.journalFile, &s);
+        }
+        return true;
+    }
+
+    // Shard count the tree was converted with, -1 if it hasn't been (or
+    // not completely). Trees converted before the marker existed have no
+    // marker but every shard's CSV, each written before its journal.
+    int shardsOnDisk() {
+        ifstream marker(shardMarker.c_str());
+        int n;
+        if (marker >> n) return n;
+
+        long long size, mtime;
+        for (int k = 0; k < SHARD_COUNT; k++) {
+            if (!fileStamp(shards[k].bookingFile, size, mtime)) return -1;
+        }
+        return SHARD_COUNT;
+    }
+
+    // Loads one snapshot-or-CSV plus its journal, each booking going to its
+    // train's shard. `owner` is the shard the files belong to, NULL for the
+    // old single file. Returns the number of journal records replayed.
+    int loadBookingFiles(const string &csvFile, const string &binFile, const string &logFile, BookingShard *owner) {
+        MappedFile file;
+        if (loadBookingSnapshot(binFile, csvFile, owner)) {
+            // the .bin matched the .csv, nothing to parse
+        } else if (file.open(csvFile)) {
+            CsvReader csv(file.data, file.size);
+            reserveBookings(owner, csv.countLines());
+
+            vector<string_view> p;
+            csv.next(p, ',');   // header
+
+            while (csv.next(p, ',')) {
+                Booking b;
+                if (!parseBooking(p, 0, b)) {
+                    BookingShard &s = owner != NULL ? *owner : shards[p.size() > 3 ? shardOf(p[3]) : 0];
+                    s.rejected.push_back(string(csv.row));
+                    continue;
+                }
+
+                loadBooking(b);
+            }
+        }
+        file.close();
+
+        return replayJournal(logFile);
+    }
+
+    void reserveBookings(BookingShard *owner, size_t n) {
+        if (owner != NULL) {
+            owner->bookings.reserve(n);
+            return;
+        }
+        for (int k = 0; k < SHARD_COUNT; k++) {
+            shards[k].bookings.reserve(n / SHARD_COUNT + 1);
+        }
+    }
+
+    BookingShard &shardFor(int trainNo) {
+        return shards[shardOf(pool.str(trainNo))];
+    }
+
+    // ---------------- BOOKING SNAPSHOT ----------------
+    bool loadBookingSnapshot(const string &binFile, const string &csvFile, BookingShard *owner) {
+        SnapshotReader snap;
+        if (!snap.open(binFile, csvFile, sizeof(BookingRecord))) return false;
+
+        // A class this build doesn't know means the .bin is damaged or from
+        // another build. The CSV is parsed instead, which moves such rows to
+        // the rejects file rather than dropping them.
+        for (unsigned long long i = 0; i < snap.header.recordCount; i++) {
+            BookingRecord r;
+            snap.record(i, &r);
+            if (r.classType < 0 || r.classType >= CLASS_COUNT) return false;
+        }
+
+        reserveBookings(owner, snap.header.recordCount);
+
+        for (unsigned long long i = 0; i < snap.header.recordCount; i++) {
+            BookingRecord r;
+            snap.record(i, &r);
+
+            Booking b;
+            b.pnr = snap.str(r.pnr);
+            b.name = snap.str(r.name);
+            b.age = r.age;
+            b.trainNo = pool.intern(snap.str(r.trainNo));
+            b.classType = (TravelClass)r.classType;
+            b.seatNo = r.seatNo;
+            b.fare = r.fare;
+            b.from = stationId(snap.str(r.from));
+            b.to = stationId(snap.str(r.to));
+            b.date = r.date;
+            loadBooking(b);
+        }
+        return true;
+    }
+
+    // Written right after the shard's CSV so the two stay in step
+    bool saveBookingSnapshot(BookingShard &s) {
+        BookingStore &bookings = s.bookings;
+        SnapshotWriter snap;
+        for (int i = 0; i < bookings.slots(); i++) {
+            if (!bookings.live[i]) continue;
+
+            BookingRecord r;
+            r.pnr = snap.str(bookings.pnr[i]);
+            r.name = snap.str(bookings.name[i]);
+            r.trainNo = snap.str(pool.str(bookings.trainNo[i]));
+            r.from = snap.str(stationName(bookings.from[i]));
+            r.to = snap.str(stationName(bookings.to[i]));
+            r.age = bookings.age[i];
+            r.seatNo = bookings.seatNo[i];
+            r.fare = bookings.fare[i];
+            r.classType = bookings.classType[i];
+            r.date = bookings.date[i];
+            r.pad = 0;
+            snap.add(&r, sizeof(r));
+        }
+        return snap.save(s.bookingSnapshot, s.bookingFile, sizeof(BookingRecord));
+    }
+
+    // Parse booking fields starting at p[k] (same order as the CSV).
+    // trainName and departure are only written for readers of the file.
+    // from/to and date came later: rows without them ride the whole run
+    // and are undated.
+    bool parseBooking(const vector<string_view> &p, int k, Booking &b) {
+        if ((int)p.size() < k + 9) return false;
+        b.pnr = p[k];
+        b.name = p[k + 1];
+        b.age = toInt(p[k + 2]);
+        b.trainNo = pool.intern(p[k + 3]);
+        b.classType = classFromCode(p[k + 5]);
+        if (b.classType == CLASS_COUNT) return false;
+        b.seatNo = toInt(p[k + 6]);
+        b.fare = toInt(p[k + 7]);
+        b.from = (int)p.size() > k + 9 ? stationId(p[k + 9]) : -1;
+        b.to = (int)p.size() > k + 10 ? stationId(p[k + 10]) : -1;
+        b.date = (int)p.size() > k + 11 ? parseDate(p[k + 11]) : -1;
+        return true;
+    }
+
+    // Blank means the train's own origin/terminus (-1)
+    int stationId(string_view name) {
+        return name.empty() ? -1 : pool.intern(name);
+    }
+
+    string stationName(int id) {
+        return id < 0 ? string() : pool.str(id);
+    }
+
+    // Name and departure come from the timetable, blank if the train is gone
+    string bookingLine(const Booking &b) {
+        const Train *t = trainOf(b);
+        stringstream ss;
+        ss << b.pnr << ","
+           << b.name << ","
+           << b.age << ","
+           << pool.str(b.trainNo) << ","
+           << (t != NULL ? pool.str(t->trainName) : "") << ","
+           << CLASS_CODES[b.classType] << ","
+           << b.seatNo << ","
+           << b.fare << ","
+           << (t != NULL ? formatTime(t->dep) : "") << ","
+           << stationName(b.from) << ","
+           << stationName(b.to) << ","
+           << formatDate(b.date);
+        return ss.str();
+    }
+
+    // ---------------- REPLAY JOURNAL ----------------
+    // "A,<booking>" re-adds a booking, "C,<pnr>" is a cancel tombstone.
+    // Records apply up to the first line that is unterminated (the crash
+    // came mid-append) or fails its CRC; the file is cut back to there so
+    // new records don't land behind garbage. Re-adding a PNR that is already
+    // loaded is skipped, so a journal whose fold was interrupted after the
+    // CSV was replaced replays harmlessly. Returns the number of records
+    // applied.
+    int replayJournal(const string &logFile) {
+        int records = 0;
+        MappedFile file;
+        if (!file.open(logFile)) return 0;
+
+        size_t good = 0;
+        vector<string_view> p;
+        while (good < file.size) {
+            const char *start = file.data + good;
+            const char *eol = (const char *)memchr(start, '\n', file.size - good);
+            if (eol == NULL) break;
+
+            string_view line(start, eol - start);
+            if (!checkJournalLine(line)) break;
+            good = eol + 1 - file.data;
+
+            CsvReader csv(line.data(), line.size());
+            if (!csv.next(p, ',')) continue;
+
+            if (p[0] == "A") {
+                Booking b;
+                if (!parseBooking(p, 1, b)) continue;
+                if (shardFor(b.trainNo).bookings.find(b.pnr) >= 0) continue;
+                loadBooking(b);
+            } else if (p[0] == "C" && p.size() >= 2) {
+                string pnr(p[1]);
+                for (int k = 0; k < SHARD_COUNT; k++) {
+                    if (removeBooking(shards[k], pnr)) break;
+                }
+                pnrGen.observe(pnr);
+            } else {
+                continue;
+            }
+            records++;
+        }
+
+        size_t size = file.size;
+        file.close();
+        if (good < size) {
+            cerr << logFile << ": dropped " << size - good << " bytes of torn or damaged records\n";
+            truncateFile(logFile, good);
+        }
+        return records;
+    }
+
+    // ---------------- SAVE BOOKINGS ----------------
+    // Full rewrite of a shard's CSV; only used when folding its journal.
+    // Rejected rows are appended to bookings.rejects first, so a crash in
+    // between can duplicate them there but never lose them.
+    bool saveBookings(BookingShard &s) {
+        if (!s.rejected.empty()) {
+            if (!saveRejects(s.rejected)) return false;
+            cerr << s.bookingFile << ": moved " << s.rejected.size() << " unreadable rows to " << rejectFile << "\n";
+            s.rejected.clear();
+        }
+
+        BookingStore &bookings = s.bookings;
+        string data = "pnr,name,age,trainNo,trainName,classType,seatNo,fare,departure,from,to,date\n";
+
+        for (int i = 0; i < bookings.slots(); i++) {
+            if (!bookings.live[i]) continue;
+            data += bookingLine(bookings.get(i));
+            data += '\n';
+        }
+        return replaceFile(s.bookingFile, data);
+    }
+
+    bool saveRejects(const vector<string> &rows) {
+        string data;
+        for (int i = 0; i < rows.size(); i++) {
+            data += rows[i];
+            data += '\n';
+        }
+
+        lock_guard<mutex> guard(rejectFileLock);
+        AppendFile file;
+        return file.open(rejectFile, false) && file.append(data) && file.sync();
+    }
+
+    // ---------------- APPEND JOURNAL ----------------
+    // Queues the record for the writer thread and returns its ticket; the
+    // caller holds the shard exclusively, so records queue in store order
+    CommitTicket appendJournal(BookingShard &s, const string &record, const JournalUndo &undo) {
+        CommitTicket t;
+        t.shard = &s - shards;
+        {
+            lock_guard<mutex> c(s.commitLock);
+            s.pending += journalLine(record);
+            s.pendingUndo.push_back(undo);
+            t.seq = ++s.queued;
+        }
+        {
+            lock_guard<mutex> lk(writerLock);
+            workQueued = true;
+        }
+        writerWake.notify_one();
+
+        // roll over: past journeys go to the archive, then the journal is
+        // folded, so a long-running service doesn't keep old dates around
+        s.journalRecords++;
+        if (s.journalRecords >= compactEvery && (archiveShard(s, today()) < 0 || !foldJournal(s))) {
+            lock_guard<mutex> c(s.commitLock);
+            s.failed = true;
+        }
+        return t;
+    }
+
+    // ---------------- GROUP COMMIT ----------------
+    // Sleeps until something is queued, leaves commitMicros for other
+    // callers to join the batch, then writes and syncs each shard's batch
+    // in one go
+    void commitLoop() {
+        while (true) {
+            {
+                unique_lock<mutex> lk(writerLock);
+                writerWake.wait(lk, [this] { return workQueued || stopping; });
+                if (!workQueued) return;
+                workQueued = false;
+            }
+            this_thread::sleep_for(chrono::microseconds(commitMicros));
+
+            for (int k = 0; k < SHARD_COUNT; k++) {
+                commitShard(shards[k], false);
+            }
+        }
+    }
+
+    // Writes the shard's queued records. If that fails (or an earlier
+    // failure left the journal in doubt), a fold saves everything in memory
+    // instead; if that fails too, the batch's changes are undone and the
+    // journal is cut back to its last synced batch, so the store matches
+    // the ERR its callers get. `reloading`: the caller holds rw exclusively
+    // and reloads everything from disk next, so nothing is undone.
+    void commitShard(BookingShard &s, bool reloading) {
+        string batch;
+        vector<JournalUndo> undo;
+        unsigned long long upto;
+        bool ok;
+        {
+            lock_guard<mutex> io(s.ioLock);
+            {
+                lock_guard<mutex> c(s.commitLock);
+                if (s.pending.empty()) return;
+                batch.swap(s.pending);
+                undo.swap(s.pendingUndo);
+                upto = s.queued;
+                ok = !s.failed;
+            }
+            if (ok) ok = writeJournal(s, batch);
+        }
+        unsigned long long first = upto - undo.size() + 1;
+
+        if (reloading) {
+            settle(s, first, upto, ok);
+            return;
+        }
+
+        shared_lock<shared_mutex> guard(rw);
+        if (ok) {
+            shared_lock<shared_mutex> shard(s.lock);
+            unholdCancelled(s, undo);
+            settle(s, first, upto, true);
+            return;
+        }
+
+        unique_lock<shared_mutex> shard(s.lock);
+        if (settledUpTo(s, upto) || foldJournal(s)) {
+            // a fold wrote out everything in memory, this batch included
+            unholdCancelled(s, undo);
+            settle(s, first, upto, true);
+            return;
+        }
+
+        undoRecords(s, undo);
+        {
+            lock_guard<mutex> io(s.ioLock);
+            bool clean = truncateFile(s.journalFile, s.journalBytes) && s.journal.open(s.journalFile, false);
+            lock_guard<mutex> c(s.commitLock);
+            s.failed = !clean;
+        }
+        settle(s, first, upto, false);
+    }
+
+    // Caller holds ioLock
+    bool writeJournal(BookingShard &s, const string &batch) {
+        if (!s.journal.isOpen()) {
+            if (!s.journal.open(s.journalFile, false)) return false;
+            long long size, mtime;
+            s.journalBytes = fileStamp(s.journalFile, size, mtime) ? size : 0;
+        }
+        if (!s.journal.append(batch) || !s.journal.sync()) return false;
+        s.journalBytes += batch.size();
+        return true;
+    }
+
+    void settle(BookingShard &s, unsigned long long first, unsigned long long upto, bool ok) {
+        {
+            lock_guard<mutex> c(s.commitLock);
+            if (!ok) s.lost.push_back(make_pair(first, upto));
+            if (s.settled < upto) s.settled = upto;
+        }
+        s.committed.notify_all();
+    }
+
+    bool settledUpTo(BookingShard &s, unsigned long long seq) {
+        lock_guard<mutex> c(s.commitLock);
+        return s.settled >= seq;
+    }
+
+    // Cancels on disk free their seats for good. Caller holds the shard.
+    void unholdCancelled(BookingShard &s, const vector<JournalUndo> &undo) {
+        for (int i = 0; i < undo.size(); i++) {
+            if (!undo[i].cancelled) continue;
+            const Booking &b = undo[i].booking;
+            const SeatMap *m = findSeatMap(s, b.date, b.trainNo, b.classType);
+            if (m != NULL) m->unhold(b.seatNo);
+        }
+    }
+
+    // Newest first. Caller holds the shard exclusively.
+    void undoRecords(BookingShard &s, const vector<JournalUndo> &undo) {
+        for (int i = (int)undo.size() - 1; i >= 0; i--) {
+            Booking b = undo[i].booking;
+            if (!undo[i].cancelled) {
+                removeBooking(s, b.pnr);
+                continue;
+            }
+
+            // the seat was held since the cancel; a rebuilt map lost that
+            int l, r;
+            bool back = false;
+            if (segmentsOf(b.trainNo, b.from, b.to, l, r)) {
+                SeatMap &m = seatMap(s, b.date, b.trainNo, b.classType);
+                back = m.takeHeld(b.seatNo, l, r);
+                if (!back) m.unhold(b.seatNo);
+            }
+            if (!back && !claimSeat(s, b)) b.seatNo = 0;
+            storeBooking(s, b);
+        }
+    }
+
+    // Blocks until the ticket's record is settled; false if it was undone
+    bool waitCommitted(const CommitTicket &t) {
+        if (t.seq == 0) return true;
+        BookingShard &s = shards[t.shard];
+        if (!writerRunning) commitShard(s, false);
+
+        unique_lock<mutex> c(s.commitLock);
+        s.committed.wait(c, [&s, &t] { return s.settled >= t.seq; });
+        for (int i = 0; i < s.lost.size(); i++) {
+            if (t.seq >= s.lost[i].first && t.seq <= s.lost[i].second) return false;
+        }
+        return true;
+    }
+
+    // ---------------- ARCHIVE ----------------
+    // Moves bookings for journeys before `date` out of the hot store into
+    // bookings.archive (same CSV lines, appended) and drops their seat
+    // partitions. Undated bookings stay. The archive is written first, so a
+    // crash before the next fold can only duplicate archived lines,
+    // never lose them. Returns the number of bookings moved.
+    int archiveBefore(int date) {
+        unique_lock<shared_mutex> guard(rw);
+        return archiveOld(date);
+    }
+
+    int archiveOld(int date) {
+        int moved = 0;
+        for (int k = 0; k < SHARD_COUNT; k++) {
+            int n = archiveShard(shards[k], date);
+            if (n < 0) return -1;
+            moved += n;
+        }
+        return moved;
+    }
+
+    // One shard's part of archiveOld(); the caller holds the shard
+    // exclusively (or rw exclusively), as on a journal roll-over
+    int archiveShard(BookingShard &s, int date) {
+        BookingStore &bookings = s.bookings;
+        vector<int> old;
+        for (int i = 0; i < bookings.slots(); i++) {
+            if (bookings.live[i] && bookings.date[i] >= 0 && bookings.date[i] < date) old.push_back(i);
+        }
+
+        if (!old.empty()) {
+            lock_guard<mutex> guard(archiveFileLock);
+            ofstream file(archiveFile.c_str(), ios::app);
+            if (!file.is_open()) return -1;
+            for (int i = 0; i < old.size(); i++) {
+                file << bookingLine(bookings.get(old[i])) << "\n";
+            }
+            file.close();
+            if (file.fail()) return -1;
+        }
+
+        for (int i = 0; i < old.size(); i++) {
+            bookings.remove(old[i]);
+        }
+
+        unordered_map<unsigned long long, vector<SeatMap> >::iterator it = s.seatMaps.begin();
+        while (it != s.seatMaps.end()) {
+            int d = (int)(it->first >> 32);
+            if (d >= 0 && d < date) it = s.seatMaps.erase(it);
+            else it++;
+        }
+        return old.size();
+    }
+
+    // ---------------- COMPACT ----------------
+    // Archive past journeys, then fold every shard's journal into fresh
+    // bookings.<k>.csv / .bin and empty it
+    bool compact() {
+        unique_lock<shared_mutex> guard(rw);
+        if (archiveOld(today()) < 0) return false;
+
+        bool ok = true;
+        for (int k = 0; k < SHARD_COUNT; k++) {
+            if (!foldJournal(shards[k])) ok = false;
+        }
+        return ok;
+    }
+
+    // Caller holds the shard exclusively (or rw exclusively), so nothing
+    // is queued meanwhile; a batch already being written lands in the old
+    // journal first, which is fine as the new files hold it too. Success
+    // settles everything queued and clears `failed`.
+    bool foldJournal(BookingShard &s) {
+        vector<JournalUndo> undo;
+        {
+            lock_guard<mutex> io(s.ioLock);
+            if (!saveBookings(s)) return false;
+            if (!saveBookingSnapshot(s)) return false;
+            if (!savePnrSequence()) return false;
+            if (!s.journal.open(s.journalFile, true)) return false;
+            s.journalBytes = 0;
+
+            lock_guard<mutex> c(s.commitLock);
+            s.pending.clear();
+            undo.swap(s.pendingUndo);
+            s.settled = s.queued;
+            s.failed = false;
+        }
+        s.committed.notify_all();
+        unholdCancelled(s, undo);
+
+        s.journalRecords = 0;
+        return true;
+    }
+
+    // ---------------- PNR SEQUENCE ----------------
+    // Saved on compaction, because cancelled PNRs leave the CSV then.
+    // Anything issued since is still in the journal and observed on replay.
+    void loadPnrSequence() {
+        pnrGen.next = pnrGen.low;
+        ifstream file(pnrFile.c_str());
+        unsigned long long n;
+        if (file >> n) pnrGen.skipTo(n);
+    }
+
+    bool savePnrSequence() {
+        lock_guard<mutex> guard(pnrFileLock);
+        return replaceFile(pnrFile, to_string(pnrGen.next.load()) + "\n");
+    }
+
+    // ---------------- SEARCH BY NAME OR STATION ----------------
+    // Trigram lookup, cheap enough to run on every keystroke
+    vector<Train> search(string key) {
+        shared_lock<shared_mutex> guard(rw);
+        vector<Train> result;
+        vector<int> hits = grams.find(key);
+
+        for (int i = 0; i < hits.size(); i++) {
+            result.push_back(trains[hits[i]]);
+        }
+        return result;
+    }
+
+    // ---------------- TRAINS BETWEEN STATIONS ----------------
+    // Exact station names; direct from -> to trains in departure order
+    vector<Train> trainsBetween(string from, string to) {
+        shared_lock<shared_mutex> guard(rw);
+        vector<Train> result;
+        int a = pool.find(from);
+        int b = pool.find(to);
+        if (a < 0 || b < 0) return result;
+
+        unordered_map<unsigned long long, vector<int> >::const_iterator it = routes.find(routeKey(a, b));
+        if (it == routes.end()) return result;
+
+        for (int i = 0; i < it->second.size(); i++) {
+            result.push_back(trains[it->second[i]]);
+        }
+        return result;
+    }
+
+    // ---------------- TRAINS SERVING A THEN B ----------------
+    // Every train calling at station a and later at station b (exact names),
+    // boarding at its first call at a, ordered by departure from a
+    vector<Leg> trainsServing(string a, string b) {
+        shared_lock<shared_mutex> guard(rw);
+        vector<Leg> result;
+        int from = pool.find(a);
+        int to = pool.find(b);
+        if (from < 0 || to < 0 || from + 1 >= callStart.size() || to + 1 >= callStart.size()) return result;
+
+        // both call lists are sorted by train, so walk them side by side
+        int i = callStart[from], iEnd = callStart[from + 1];
+        int j = callStart[to], jEnd = callStart[to + 1];
+        while (i < iEnd && j < jEnd) {
+            int ti = stationCalls[i].first;
+            int tj = stationCalls[j].first;
+            if (ti < tj) {
+                i++;
+            } else if (tj < ti) {
+                j++;
+            } else {
+                Leg leg;
+                leg.train = ti;
+                leg.board = stationCalls[i].second;
+                leg.alight = -1;
+                for (; j < jEnd && stationCalls[j].first == ti; j++) {
+                    if (leg.alight < 0 && stationCalls[j].second > leg.board) {
+                        leg.alight = stationCalls[j].second;
+                    }
+                }
+                while (i < iEnd && stationCalls[i].first == ti) i++;
+
+                if (leg.alight >= 0) {
+                    leg.trainNo = trains[ti].trainNo;
+                    leg.trainName = trains[ti].trainName;
+                    leg.dep = stopOf(ti, leg.board).dep;
+                    leg.arr = stopOf(ti, leg.alight).arr;
+                    result.push_back(leg);
+                }
+            }
+        }
+
+        stable_sort(result.begin(), result.end(), [this](const Leg &x, const Leg &y) {
+            return x.dep < y.dep;
+        });
+        return result;
+    }
+
+    // ---------------- TRAINS LEAVING BETWEEN ----------------
+    // Trains whose origin departure lies in [from, to] minutes, in departure
+    // order. from > to wraps past midnight (22:00 - 02:00).
+    vector<Train> trainsLeaving(int from, int to) {
+        shared_lock<shared_mutex> guard(rw);
+        vector<Train> result;
+        if (from < 0 || to < 0) return result;
+
+        if (from <= to) {
+            appendLeaving(from, to, result);
+        } else {
+            appendLeaving(from, 24 * 60 - 1, result);
+            appendLeaving(0, to, result);
+        }
+        return result;
+    }
+
+    vector<Train> trainsLeaving(string from, string to) {
+        return trainsLeaving(parseTime(from), parseTime(to));
+    }
+
+    void appendLeaving(int from, int to, vector<Train> &result) {
+        vector<int>::iterator first = lower_bound(departures.begin(), departures.end(), from,
+                                                  [this](int i, int t) { return trains[i].dep < t; });
+        vector<int>::iterator last = upper_bound(first, departures.end(), to,
+                                                 [this](int t, int i) { return t < trains[i].dep; });
+        for (; first != last; first++) {
+            result.push_back(trains[*first]);
+        }
+    }
+
+    // ---------------- FIND BY NUMBER ----------------
+    const Train* findByNumber(string no) {
+        shared_lock<shared_mutex> guard(rw);
+        return findById(pool.find(no));
+    }
+
+    // Copying variant of findByNumber() for use across threads
+    bool trainByNumber(string no, Train &out) {
+        shared_lock<shared_mutex> guard(rw);
+        const Train *t = findById(pool.find(no));
+        if (t == NULL) return false;
+        out = *t;
+        return true;
+    }
+
+    // ---------------- NAMES ----------------
+    // pool lookups under the lock: intern() may grow the pool during a load
+    string name(int id) {
+        shared_lock<shared_mutex> guard(rw);
+        return id >= 0 ? pool.str(id) : string();
+    }
+
+    // Id of an already known string, -1 otherwise (never interns)
+    int idOf(string_view s) {
+        shared_lock<shared_mutex> guard(rw);
+        return pool.find(s);
+    }
+
+    // CSV fields of a booking returned by findBookings()
+    string describeBooking(const Booking &b) {
+        shared_lock<shared_mutex> guard(rw);
+        return bookingLine(b);
+    }
+
+    // Train for a pool id of a train number, NULL if not in the timetable
+    const Train* findById(int trainNo) {
+        if (trainNo < 0 || trainNo >= trainIndex.size() || trainIndex[trainNo] < 0) return NULL;
+        return &trains[trainIndex[trainNo]];
+    }
+
+    const Train* trainOf(const Booking &b) {
+        return findById(b.trainNo);
+    }
+
+    // ---------------- SEAT INVENTORY ----------------
+    static unsigned long long partitionKey(int date, int trainNo) {
+        return ((unsigned long long)(unsigned int)date << 32) | (unsigned int)trainNo;
+    }
+
+    // Created on first use, every class sized from seatCapacity and split
+    // into one segment per pair of consecutive stops
+    SeatMap &seatMap(BookingShard &s, int date, int trainNo, TravelClass cls) {
+        unordered_map<unsigned long long, vector<SeatMap> >::iterator it = s.seatMaps.find(partitionKey(date, trainNo));
+        if (it != s.seatMaps.end()) return it->second[cls];
+
+        const Train *t = findById(trainNo);
+        int segs = t != NULL ? stopCount(t - &trains[0]) - 1 : 1;
+
+        vector<SeatMap> &maps = s.seatMaps[partitionKey(date, trainNo)];
+        maps.resize(CLASS_COUNT);
+        for (int c = 0; c < CLASS_COUNT; c++) {
+            maps[c].resize(seatCapacity[c], segs);
+        }
+        return maps[cls];
+    }
+
+    // Segments [l, r) ridden from station `from` to station `to` (-1 for the
+    // train's origin/terminus). False if the train doesn't call at them in
+    // that order. A train gone from the timetable has a single segment.
+    bool segmentsOf(int trainNo, int from, int to, int &l, int &r) {
+        const Train *t = findById(trainNo);
+        if (t == NULL) {
+            l = 0;
+            r = 1;
+            return true;
+        }
+
+        int train = t - &trains[0];
+        int n = stopCount(train);
+        l = 0;
+        r = max(n - 1, 1);
+
+        if (from >= 0) {
+            for (l = 0; l < n - 1 && stopOf(train, l).station != from; l++) {}
+            if (l >= n - 1) return false;
+        }
+        if (to >= 0) {
+            for (r = l + 1; r < n && stopOf(train, r).station != to; r++) {}
+            if (r >= n) return false;
+        }
+        return true;
+    }
+
+    // Reservations held in a class, whatever their legs
+    // Lookups don't create partitions, so browsing dates costs no memory
+    const SeatMap *findSeatMap(const BookingShard &s, int date, int trainNo, TravelClass cls) const {
+        unordered_map<unsigned long long, vector<SeatMap> >::const_iterator it = s.seatMaps.find(partitionKey(date, trainNo));
+        if (it == s.seatMaps.end()) return NULL;
+        return &it->second[cls];
+    }
+
+    int bookedCount(int date, int trainNo, TravelClass cls) {
+        shared_lock<shared_mutex> guard(rw);
+        BookingShard &s = shardFor(trainNo);
+        shared_lock<shared_mutex> shard(s.lock);
+        const SeatMap *m = findSeatMap(s, date, trainNo, cls);
+        return m != NULL ? m->used : 0;
+    }
+
+    // Seats still free for the whole of from -> to on that date
+    int freeSeats(int date, int trainNo, TravelClass cls, int from, int to) {
+        shared_lock<shared_mutex> guard(rw);
+        int l, r;
+        if (!segmentsOf(trainNo, from, to, l, r)) return 0;
+
+        BookingShard &s = shardFor(trainNo);
+        shared_lock<shared_mutex> shard(s.lock);
+        const SeatMap *m = findSeatMap(s, date, trainNo, cls);
+        return m != NULL ? m->freeCount(l, r) : seatCapacity[cls];
+    }
+
+    // Best free seat for from -> to on that date, or -1 if there is none
+    int nextSeat(int date, int trainNo, TravelClass cls, int from, int to) {
+        shared_lock<shared_mutex> guard(rw);
+        int l, r;
+        if (!segmentsOf(trainNo, from, to, l, r)) return -1;
+
+        // read-only: an untouched date has every seat free
+        BookingShard &s = shardFor(trainNo);
+        shared_lock<shared_mutex> shard(s.lock);
+        const SeatMap *m = findSeatMap(s, date, trainNo, cls);
+        if (m == NULL) return seatCapacity[cls] > 0 ? 1 : -1;
+        return m->firstFree(l, r);
+    }
+
+    // New bookings: from today up to bookingHorizon days ahead
+    bool bookableDate(int date) {
+        int now = today();
+        return date >= now && date <= now + bookingHorizon;
+    }
+
+    // Claim b.seatNo for b's leg, falling back to the best free seat if it
+    // was taken in the meantime. Returns false (seat unchanged) when the
+    // class is full for that leg or the train doesn't run it.
+    bool claimSeat(BookingShard &s, Booking &b) {
+        int l, r;
+        if (!segmentsOf(b.trainNo, b.from, b.to, l, r)) return false;
+
+        SeatMap &m = seatMap(s, b.date, b.trainNo, b.classType);
+        if (m.take(b.seatNo, l, r)) return true;
+
+        int seat = m.firstFree(l, r);
+        if (seat < 0) return false;
+        m.take(seat, l, r);
+        b.seatNo = seat;
+        return true;
+    }
+
+    // Stop lists may have changed with the timetable: re-take every live
+    // booking's seat on freshly sized maps
+    void rebuildSeatMaps(BookingShard &s) {
+        s.seatMaps.clear();
+        for (int i = 0; i < s.bookings.slots(); i++) {
+            if (!s.bookings.live[i]) continue;
+
+            Booking b = s.bookings.get(i);
+            if (!claimSeat(s, b)) b.seatNo = 0;
+            s.bookings.seatNo[i] = b.seatNo;
+        }
+    }
+
+    // ---------------- FIND BY PNR ----------------
+    vector<Booking> findBookings(string pnr) {
+        shared_lock<shared_mutex> guard(rw);
+        vector<Booking> result;
+        for (int k = 0; k < SHARD_COUNT; k++) {
+            BookingStore &bookings = shards[k].bookings;
+            shared_lock<shared_mutex> shard(shards[k].lock);
+            pair<unordered_multimap<string, int>::iterator,
+                 unordered_multimap<string, int>::iterator> range = bookings.pnrIndex.equal_range(pnr);
+            for (unordered_multimap<string, int>::iterator it = range.first; it != range.second; it++) {
+                result.push_back(bookings.get(it->second));
+            }
+        }
+        return result;
+    }
+
+    // ---------------- REPORTS ----------------
+    // Column scans: each reads only the live flag and the columns it needs,
+    // one shard at a time
+    int bookingCount() {
+        shared_lock<shared_mutex> guard(rw);
+        int n = 0;
+        for (int k = 0; k < SHARD_COUNT; k++) {
+            shared_lock<shared_mutex> shard(shards[k].lock);
+            n += shards[k].bookings.liveCount;
+        }
+        return n;
+    }
+
+    long long totalRevenue() {
+        shared_lock<shared_mutex> guard(rw);
+        long long sum = 0;
+        for (int k = 0; k < SHARD_COUNT; k++) {
+            BookingStore &bookings = shards[k].bookings;
+            shared_lock<shared_mutex> shard(shards[k].lock);
+            for (int i = 0; i < bookings.slots(); i++) {
+                if (bookings.live[i]) sum += bookings.fare[i];
+            }
+        }
+        return sum;
+    }
+
+    // Only the train's own shard can hold its bookings
+    long long trainRevenue(int trainNo) {
+        shared_lock<shared_mutex> guard(rw);
+        BookingShard &s = shardFor(trainNo);
+        shared_lock<shared_mutex> shard(s.lock);
+        long long sum = 0;
+        for (int i = 0; i < s.bookings.slots(); i++) {
+            if (s.bookings.live[i] && s.bookings.trainNo[i] == trainNo) sum += s.bookings.fare[i];
+        }
+        return sum;
+    }
+
+    // Booked seats per class over all trains
+    vector<int> occupancyByClass() {
+        shared_lock<shared_mutex> guard(rw);
+        vector<int> count(CLASS_COUNT, 0);
+        for (int k = 0; k < SHARD_COUNT; k++) {
+            BookingStore &bookings = shards[k].bookings;
+            shared_lock<shared_mutex> shard(shards[k].lock);
+            for (int i = 0; i < bookings.slots(); i++) {
+                if (bookings.live[i]) count[bookings.classType[i]]++;
+            }
+        }
+        return count;
+    }
+
+    // ---------------- PNR GENERATOR ----------------
+    string generatePNR() {
+        return pnrGen.make();
+    }
+
+    // ---------------- ADD BOOKING ----------------
+    // Assigns the seat actually claimed to b.seatNo; refuses to overbook.
+    // Only b's shard is locked for writing. Returns once the booking is on
+    // disk; the ticket variants return at once and leave the wait to
+    // waitCommitted(), so one caller can have several bookings in a batch.
+    bool addBooking(Booking &b) {
+        CommitTicket t;
+        return addBooking(b, t) && waitCommitted(t);
+    }
+
+    bool addBooking(Booking &b, CommitTicket &t) {
+        shared_lock<shared_mutex> guard(rw);
+        BookingShard &s = shardFor(b.trainNo);
+        unique_lock<shared_mutex> shard(s.lock);
+        if (!claimSeat(s, b)) return false;
+        storeBooking(s, b);
+        t = appendJournal(s, "A," + bookingLine(b), JournalUndo(false, b));
+        return true;
+    }
+
+    // ---------------- RESERVED BOOKING ----------------
+    // Proceed -> Confirm for concurrent clients. reserveSeat() holds the best
+    // free seat with one CAS on its class's hold word while only sharing the
+    // locks, so racing clients are handed different seats, and addBooking()
+    // won't take a held seat either. bookReserved() turns the hold on
+    // b.seatNo into the booking; releaseSeat() drops it when the customer
+    // walks away. -1 when the leg has no free seat.
+    int reserveSeat(int date, int trainNo, TravelClass cls, int from, int to) {
+        shared_lock<shared_mutex> guard(rw);
+        int l, r;
+        if (!segmentsOf(trainNo, from, to, l, r)) return -1;
+
+        BookingShard &s = shardFor(trainNo);
+        {
+            shared_lock<shared_mutex> shard(s.lock);
+            const SeatMap *m = findSeatMap(s, date, trainNo, cls);
+            if (m != NULL) return m->reserve(l, r);
+        }
+
+        // first reservation for that date: the partition has to be created
+        unique_lock<shared_mutex> shard(s.lock);
+        return seatMap(s, date, trainNo, cls).reserve(l, r);
+    }
+
+    bool bookReserved(Booking &b) {
+        CommitTicket t;
+        return bookReserved(b, t) && waitCommitted(t);
+    }
+
+    // The hold already keeps everyone else off the seat, so the record is
+    // built before the shard is locked; the exclusive section is only the
+    // bitmap update, the insert and queueing the record
+    bool bookReserved(Booking &b, CommitTicket &t) {
+        shared_lock<shared_mutex> guard(rw);
+        int l, r;
+        if (!segmentsOf(b.trainNo, b.from, b.to, l, r)) {
+            unholdSeat(b.date, b.trainNo, b.classType, b.seatNo);
+            return false;
+        }
+        string record = "A," + bookingLine(b);
+
+        BookingShard &s = shardFor(b.trainNo);
+        unique_lock<shared_mutex> shard(s.lock);
+        SeatMap &m = seatMap(s, b.date, b.trainNo, b.classType);
+        if (!m.takeHeld(b.seatNo, l, r)) {
+            // hold lost with a rebuilt map: fall back to any free seat
+            m.unhold(b.seatNo);
+            if (!claimSeat(s, b)) return false;
+            record = "A," + bookingLine(b);
+        }
+
+        storeBooking(s, b);
+        t = appendJournal(s, record, JournalUndo(false, b));
+        return true;
+    }
+
+    void releaseSeat(int date, int trainNo, TravelClass cls, int seat) {
+        shared_lock<shared_mutex> guard(rw);
+        unholdSeat(date, trainNo, cls, seat);
+    }
+
+    // Caller holds rw shared
+    void unholdSeat(int date, int trainNo, TravelClass cls, int seat) {
+        BookingShard &s = shardFor(trainNo);
+        shared_lock<shared_mutex> shard(s.lock);
+        const SeatMap *m = findSeatMap(s, date, trainNo, cls);
+        if (m != NULL) m->unhold(seat);
+    }
+
+    // Older files can hold clashing seats: those move to the lowest free
+    // seat. Rows beyond capacity are still kept, with seat 0.
+    void loadBooking(Booking &b) {
+        BookingShard &s = shardFor(b.trainNo);
+        if (!claimSeat(s, b)) b.seatNo = 0;
+        storeBooking(s, b);
+    }
+
+    void storeBooking(BookingShard &s, const Booking &b) {
+        s.bookings.insert(b);
+        pnrGen.observe(b.pnr);
+    }
+
+    bool removeBooking(BookingShard &s, string pnr) {
+        BookingStore &bookings = s.bookings;
+        int slot = bookings.find(pnr);
+        if (slot < 0) return false;
+
+        int l, r;
+        if (segmentsOf(bookings.trainNo[slot], bookings.from[slot], bookings.to[slot], l, r)) {
+            seatMap(s, bookings.date[slot], bookings.trainNo[slot], (TravelClass)bookings.classType[slot])
+                .release(bookings.seatNo[slot], l, r);
+        }
+        bookings.remove(slot);
+        return true;
+    }
+
+    // ---------------- CANCEL BOOKING ----------------
+    // A PNR doesn't name its train, so each shard is asked in turn. The
+    // freed seat is held until the cancel is on disk (see JournalUndo).
+    bool cancel(string pnr) {
+        CommitTicket t;
+        return cancel(pnr, t) && waitCommitted(t);
+    }
+
+    bool cancel(string pnr, CommitTicket &t) {
+        shared_lock<shared_mutex> guard(rw);
+        for (int k = 0; k < SHARD_COUNT; k++) {
+            BookingShard &s = shards[k];
+            unique_lock<shared_mutex> shard(s.lock);
+            int slot = s.bookings.find(pnr);
+            if (slot < 0) continue;
+
+            Booking b = s.bookings.get(slot);
+            removeBooking(s, pnr);
+            const SeatMap *m = findSeatMap(s, b.date, b.trainNo, b.classType);
+            if (m != NULL) m->hold(b.seatNo);
+            t = appendJournal(s, "C," + pnr, JournalUndo(true, b));
+            return true;
+        }
+        return false;
+    }
+};
+
+// -------------------- BOOKING SERVICE --------------------
+// Serves one in-memory Database to any number of local front ends over a
+// Unix domain socket (AF_UNIX, also available on Windows 10 and later).
+//
+// Requests and replies are text lines with tab-separated fields. A reply
+// starts with "OK <n>" followed by n result lines, or a single "ERR <why>".
+// Blank optional fields mean the train's own origin/terminus.
+//
+//   S <key>                                   trains by name/station substring
+//                                             -> trainNo name from to dep arr
+//   R <from> <to>                             trains calling at from, then to
+//                                             -> trainNo name dep arr
+//   A <trainNo> <date> [from] [to]            free seats per class
+//                                             -> class free fare
+//   B <name> <age> <trainNo> <class> <date> [from] [to]
+//                                             -> pnr seat fare
+//   P <pnr>                                   -> one booking line (CSV fields)
+//   C <pnr>                                   cancel -> OK 0
+//
+// Dates are YYYY-MM-DD, times HH:MM. All clients are multiplexed with poll()
+// on one thread; the service only goes through Database's locked methods, so
+// other threads may share the same Database. Replies to bookings and cancels
+// are held until the journal batch holding them is on disk, so every client
+// served in one poll round shares a single sync.
+class BookingService {
+public:
+    BookingService(Database &database) : db(database) {
+        listener = BAD_SOCKET;
+    }
+
+    ~BookingService() {
+        for (int i = 0; i < clients.size(); i++) {
+            closeSocket(clients[i].fd);
+        }
+        if (listener != BAD_SOCKET) {
+            closeSocket(listener);
+            remove(path.c_str());
+        }
+    }
+
+    // Binds the socket file at socketPath, replacing a stale one
+    bool listen(const string &socketPath) {
+        path = socketPath;
+
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(addr.sun_path)) return false;
+        strcpy(addr.sun_path, path.c_str());
+
+        listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listener == BAD_SOCKET) return false;
+
+        remove(path.c_str());
+        if (bind(listener, (sockaddr *)&addr, sizeof(addr)) != 0 || ::listen(listener, 16) != 0) {
+            closeSocket(listener);
+            listener = BAD_SOCKET;
+            return false;
+        }
+        setNonBlocking(listener);
+        return true;
+    }
+
+    // Serves until stop becomes non-zero (checked at least once a second)
+    void run(volatile sig_atomic_t &stop) {
+        vector<pollfd> fds;
+        while (!stop) {
+            fds.clear();
+            pollfd p;
+            p.fd = listener;
+            p.events = POLLIN;
+            p.revents = 0;
+            fds.push_back(p);
+            for (int i = 0; i < clients.size(); i++) {
+                p.fd = clients[i].fd;
+                p.events = (clients[i].done ? 0 : POLLIN) | (clients[i].out.empty() ? 0 : POLLOUT);
+                p.revents = 0;
+                fds.push_back(p);
+            }
+
+            if (pollSockets(&fds[0], fds.size(), 1000) <= 0) continue;
+
+            // clients first: accepting below appends to the client list
+            for (int i = (int)clients.size() - 1; i >= 0; i--) {
+                short ev = fds[i + 1].revents;
+                bool ok = true;
+                if (ev & POLLIN) ok = readFrom(clients[i]);
+                else if (ev & (POLLERR | POLLHUP | POLLNVAL)) ok = false;
+                if (ok && (ev & POLLOUT)) ok = writeTo(clients[i]);
+                // a client that stopped sending goes once its replies are out
+                if (clients[i].done && clients[i].out.empty() && clients[i].waiting.empty()) ok = false;
+
+                if (!ok) {
+                    closeSocket(clients[i].fd);
+                    clients.erase(clients.begin() + i);
+                }
+            }
+
+            if (fds[0].revents & POLLIN) {
+                socket_t fd = accept(listener, NULL, NULL);
+                if (fd != BAD_SOCKET) {
+                    setNonBlocking(fd);
+                    Client c;
+                    c.fd = fd;
+                    c.done = false;
+                    clients.push_back(c);
+                }
+            }
+
+            releaseReplies();
+        }
+    }
+
+    // Waits for this round's bookings to be committed, then sends the
+    // replies that were held back for them
+    void releaseReplies() {
+        for (int i = 0; i < clients.size(); i++) {
+            Client &c = clients[i];
+            if (c.waiting.empty()) continue;
+
+            for (int j = 0; j < c.waiting.size(); j++) {
+                if (db.waitCommitted(c.waiting[j].second)) c.out += c.waiting[j].first;
+                else c.out += "ERR not saved, nothing changed\n";
+            }
+            c.waiting.clear();
+            // a failed send surfaces as POLLERR/POLLHUP on the next round
+            writeTo(c);
+        }
+    }
+
+    // ---------------- REQUESTS ----------------
+    // Bookings and cancels set `ticket`: their reply stands only once it is committed
+    string handle(string_view line, CommitTicket &ticket) {
+        vector<string_view> f;
+        CsvReader csv(line.data(), line.size());
+        if (!csv.next(f, '\t')) return "ERR empty request\n";
+
+        string_view verb = f[0];
+        if (verb == "S" && f.size() >= 1) return search(f.size() > 1 ? f[1] : string_view());
+        if (verb == "R" && f.size() >= 3) return route(f[1], f[2]);
+        if (verb == "A" && f.size() >= 3) return availability(f);
+        if (verb == "B" && f.size() >= 6) return book(f, ticket);
+        if (verb == "P" && f.size() >= 2) return lookup(f[1]);
+        if (verb == "C" && f.size() >= 2) return cancel(f[1], ticket);
+        return "ERR unknown request\n";
+    }
+
+private:
+    struct Client {
+        socket_t fd;
+        string in;
+        string out;
+        bool done;      // end of input seen, close after flushing out
+
+        // replies held until their booking is committed, in request order
+        vector<pair<string, CommitTicket> > waiting;
+    };
+
+    static const size_t MAX_LINE = 64 * 1024;
+
+    Database &db;
+    socket_t listener;
+    string path;
+    vector<Client> clients;
+
+    // Appends every complete request's reply to c.out
+    bool readFrom(Client &c) {
+        char buf[4096];
+        int n = recv(c.fd, buf, sizeof(buf), 0);
+        if (n < 0) return wouldBlock();
+        if (n == 0) {
+            c.done = true;
+            return true;
+        }
+        c.in.append(buf, n);
+
+        size_t start = 0;
+        size_t eol;
+        while ((eol = c.in.find('\n', start)) != string::npos) {
+            CommitTicket ticket;
+            string reply = handle(string_view(c.in.data() + start, eol - start), ticket);
+            // a reply queues behind held ones so replies keep request order
+            if (ticket.seq == 0 && c.waiting.empty()) c.out += reply;
+            else c.waiting.push_back(make_pair(reply, ticket));
+            start = eol + 1;
+        }
+        c.in.erase(0, start);
+        if (c.in.size() > MAX_LINE) return false;
+
+        return c.out.empty() || writeTo(c);
+    }
+
+    bool writeTo(Client &c) {
+        while (!c.out.empty()) {
+            int n = send(c.fd, c.out.data(), c.out.size(), 0);
+            if (n <= 0) return wouldBlock();
+            c.out.erase(0, n);
+        }
+        return true;
+    }
+
+    static string ok(int n, const string &rows) {
+        return "OK " + to_string(n) + "\n" + rows;
+    }
+
+    string trainRow(const Train &t) {
+        return db.name(t.trainNo) + "\t" + db.name(t.trainName) + "\t" +
+               db.name(t.from) + "\t" + db.name(t.to) + "\t" +
+               formatTime(t.dep) + "\t" + formatTime(t.arr) + "\n";
+    }
+
+    // Station names are looked up, never interned, so requests can't grow the pool
+    bool station(string_view name, int &id) {
+        if (name.empty()) {
+            id = -1;
+            return true;
+        }
+        id = db.idOf(name);
+        return id >= 0;
+    }
+
+    string search(string_view key) {
+        vector<Train> found = db.search(string(key));
+        string rows;
+        for (int i = 0; i < found.size(); i++) {
+            rows += trainRow(found[i]);
+        }
+        return ok(found.size(), rows);
+    }
+
+    string route(string_view from, string_view to) {
+        vector<Leg> legs = db.trainsServing(string(from), string(to));
+        string rows;
+        for (int i = 0; i < legs.size(); i++) {
+            rows += db.name(legs[i].trainNo) + "\t" + db.name(legs[i].trainName) + "\t" +
+                    formatTime(legs[i].dep) + "\t" + formatTime(legs[i].arr) + "\n";
+        }
+        return ok(legs.size(), rows);
+    }
+
+    string availability(const vector<string_view> &f) {
+        Train t;
+        if (!db.trainByNumber(string(f[1]), t)) return "ERR unknown train\n";
+        int date = parseDate(f[2]);
+        if (date < 0) return "ERR bad date\n";
+
+        int from, to;
+        if (!station(f.size() > 3 ? f[3] : string_view(), from) ||
+            !station(f.size() > 4 ? f[4] : string_view(), to)) return "ERR unknown station\n";
+
+        string rows;
+        int n = 0;
+        for (int c = 0; c < CLASS_COUNT; c++) {
+            if (!t.hasClass((TravelClass)c)) continue;
+            rows += string(CLASS_CODES[c]) + "\t" +
+                    to_string(db.freeSeats(date, t.trainNo, (TravelClass)c, from, to)) + "\t" +
+                    to_string(db.fares[c]) + "\n";
+            n++;
+        }
+        return ok(n, rows);
+    }
+
+    string book(const vector<string_view> &f, CommitTicket &ticket) {
+        Booking b;
+        b.name = f[1];
+        if (b.name.empty() || b.name.find(',') != string::npos) return "ERR bad name\n";
+        b.age = toInt(f[2]);
+        if (b.age <= 0) return "ERR bad age\n";
+
+        Train t;
+        if (!db.trainByNumber(string(f[3]), t)) return "ERR unknown train\n";
+        b.trainNo = t.trainNo;
+
+        b.classType = classFromCode(f[4]);
+        if (b.classType == CLASS_COUNT || !t.hasClass(b.classType)) return "ERR class not on this train\n";
+
+        b.date = parseDate(f[5]);
+        if (!db.bookableDate(b.date)) return "ERR date outside the booking window\n";
+
+        if (!station(f.size() > 6 ? f[6] : string_view(), b.from) ||
+            !station(f.size() > 7 ? f[7] : string_view(), b.to)) return "ERR unknown station\n";
+
+        b.pnr = db.generatePNR();
+        b.fare = db.fares[b.classType];
+        b.seatNo = db.reserveSeat(b.date, b.trainNo, b.classType, b.from, b.to);
+        if (b.seatNo < 0 || !db.bookReserved(b, ticket)) return "ERR no seat (class full or leg not on route)\n";
+
+        return ok(1, b.pnr + "\t" + to_string(b.seatNo) + "\t" + to_string(b.fare) + "\n");
+    }
+
+    string lookup(string_view pnr) {
+        vector<Booking> found = db.findBookings(string(pnr));
+        string rows;
+        for (int i = 0; i < found.size(); i++) {
+            rows += db.describeBooking(found[i]) + "\n";
+        }
+        return ok(found.size(), rows);
+    }
+
+    string cancel(string_view pnr, CommitTicket &ticket) {
+        if (!db.cancel(string(pnr), ticket)) return "ERR no such booking\n";
+        return ok(0, "");
+    }
+};
+
+// -------------------- MAIN --------------------
+// Left out when another program (stresstest.cpp) includes this file
+#ifndef BOOKINGD_NO_MAIN
+static volatile sig_atomic_t stopRequested = 0;
+
+static void onStopSignal(int) {
+    stopRequested = 1;
+}
+
+// Usage: datamanager [socket path] [commit interval in microseconds]
+//        (defaults booking.sock and 2000)
+int main(int argc, char **argv) {
+    string socketPath = argc > 1 ? argv[1] : "booking.sock";
+
+    DirectoryLock lock;
+    if (!lock.acquire("bookings.lock")) {
+        cerr << "The GUI or another bookingd is already using the bookings in this directory.\n";
+        return 1;
+    }
+
+#ifdef _WIN32
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {
+        cerr << "Winsock unavailable.\n";
+        return 1;
+    }
+#else
+    signal(SIGPIPE, SIG_IGN);
+#endif
+    signal(SIGINT, onStopSignal);
+    signal(SIGTERM, onStopSignal);
+
+    Database db;
+    if (argc > 2) db.commitMicros = max(toInt(argv[2]), 0);
+    if (!db.loadTrains()) {
+        cerr << "Cannot read " << db.trainFile << "\n";
+        return 1;
+    }
+    if (!db.loadBookings()) {
+        cerr << "Cannot load the bookings.\n";
+        return 1;
+    }
+
+    cout << "Database Loaded Successfully.\n";
+
+    int status = 0;
+    {
+        BookingService service(db);
+        if (service.listen(socketPath)) {
+            cout << "Listening on " << socketPath << "\n";
+            service.run(stopRequested);
+        } else {
+            cerr << "Cannot listen on " << socketPath << "\n";
+            status = 1;
+        }
+    }
+
+    // fold the journals back into the shard files before exiting
+    db.compact();
+
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    return status;
 }
+#endif
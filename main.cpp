@@ -13,194 +13,2113 @@
 #include <vector>
 #include <map>
 #include <set>
+#include <unordered_map>
+#include <deque>
 #include <string>
 #include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <string_view>
 #include <ctime>
+#include <csignal>
+#include <cerrno>
+#include <algorithm>
+
+#include <sys/stat.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <winsock2.h>
+#include <afunix.h>
+#include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "bookingfiles.h"
 
 using namespace std;
 
+// ---------------- TRAVEL CLASSES ----------------
+enum TravelClass { CLASS_1A, CLASS_2A, CLASS_3A, CLASS_3E, CLASS_SL, CLASS_CC, CLASS_2S, CLASS_COUNT };
+
+static const char *CLASS_CODES[CLASS_COUNT]={"1A","2A","3A","3E","SL","CC","2S"};
+
+// CLASS_COUNT for an unknown code
+static TravelClass classFromCode(string_view code) {
+    for (int c=0;c<CLASS_COUNT;c++)
+        if (code==CLASS_CODES[c]) return (TravelClass)c;
+    return CLASS_COUNT;
+}
+
+static unsigned int classBit(TravelClass c) { return 1u<<c; }
+
+// ---------------- STRING POOL ----------------
+// every distinct string stored once, referred to by an int id;
+// a deque so the string_view keys never move
+struct StringPool {
+    deque<string> values;
+    unordered_map<string_view,int> ids;
+
+    int intern(string_view s) {
+        unordered_map<string_view,int>::iterator it=ids.find(s);
+        if (it!=ids.end()) return it->second;
+        values.push_back(string(s));
+        int id=values.size()-1;
+        ids[values.back()]=id;
+        return id;
+    }
+
+    // -1 if not interned (does not add)
+    int find(string_view s) const {
+        unordered_map<string_view,int>::const_iterator it=ids.find(s);
+        return it==ids.end() ? -1 : it->second;
+    }
+
+    const string &str(int id) const { return values[id]; }
+    int size() const { return values.size(); }
+};
+
 // ---------------- SIMPLE TRAIN & BOOKING STRUCT ----------------
+// trainNo, trainName, from, to are StringPool ids
 struct Train {
-    string trainNo, trainName, from, to, arr, dep, stop;
-    set<string> classes;
+    int trainNo, trainName, from, to;
+    short arr, dep; // minutes since midnight (terminus / origin), -1 unknown
+    string stop;
+    unsigned int classes; // bitmask of classBit()
+
+    bool hasClass(TravelClass c) const { return (classes&classBit(c))!=0; }
+};
+
+// one call at a station; minutes since midnight, -1 for none
+struct Stop {
+    int station; // pool id
+    short arr, dep;
+};
+
+// ride train (position in trains) from stop index board to a later alight
+struct Leg {
+    int train, board, alight;
 };
 
+// "HH:MM" -> minutes since midnight, -1 if malformed
+static int parseTime(string_view s) {
+    size_t colon=s.find(':');
+    if (colon==string_view::npos || colon==0 || colon>2 || s.size()!=colon+3) return -1;
+    int h=0, m=0;
+    for (size_t i=0;i<s.size();i++) {
+        if (i==colon) continue;
+        if (s[i]<'0' || s[i]>'9') return -1;
+        if (i<colon) h=h*10+(s[i]-'0'); else m=m*10+(s[i]-'0');
+    }
+    if (h>23 || m>59) return -1;
+    return h*60+m;
+}
+
+static string formatTime(int minutes) {
+    if (minutes<0) return "--:--";
+    char buf[8];
+    snprintf(buf,sizeof(buf),"%02d:%02d",minutes/60%24,minutes%60);
+    return buf;
+}
+
+// ---------------- DATES ----------------
+// journey dates are day numbers (days since 1970-01-01), -1 = undated
+
+static int daysFromCivil(int y, int m, int d) {
+    y-=m<=2;
+    int era=(y>=0 ? y : y-399)/400;
+    int yoe=y-era*400;
+    int doy=(153*(m+(m>2 ? -3 : 9))+2)/5+d-1;
+    int doe=yoe*365+yoe/4-yoe/100+doy;
+    return era*146097+doe-719468;
+}
+
+static void civilFromDays(int z, int &y, int &m, int &d) {
+    z+=719468;
+    int era=(z>=0 ? z : z-146096)/146097;
+    int doe=z-era*146097;
+    int yoe=(doe-doe/1460+doe/36524-doe/146096)/365;
+    int doy=doe-(365*yoe+yoe/4-yoe/100);
+    int mp=(5*doy+2)/153;
+    d=doy-(153*mp+2)/5+1;
+    m=mp+(mp<10 ? 3 : -9);
+    y=yoe+era*400+(m<=2);
+}
+
+// "YYYY-MM-DD" -> day number, -1 if not a real date
+static int parseDate(string_view s) {
+    if (s.size()!=10 || s[4]!='-' || s[7]!='-') return -1;
+    for (int i=0;i<10;i++) if (i!=4 && i!=7 && (s[i]<'0' || s[i]>'9')) return -1;
+    int y=(s[0]-'0')*1000+(s[1]-'0')*100+(s[2]-'0')*10+(s[3]-'0');
+    int m=(s[5]-'0')*10+(s[6]-'0'), d=(s[8]-'0')*10+(s[9]-'0');
+    if (m<1 || m>12 || d<1 || d>31) return -1;
+    int day=daysFromCivil(y,m,d), cy, cm, cd;
+    civilFromDays(day,cy,cm,cd);
+    return (cm==m && cd==d) ? day : -1; // 31 Apr, 29 Feb in other years
+}
+
+static string formatDate(int day) {
+    if (day<0) return "";
+    int y, m, d;
+    civilFromDays(day,y,m,d);
+    char buf[16];
+    snprintf(buf,sizeof(buf),"%04d-%02d-%02d",y,m,d);
+    return buf;
+}
+
+static int today() {
+    time_t now=time(NULL);
+    struct tm *t=localtime(&now);
+    return daysFromCivil(t->tm_year+1900,t->tm_mon+1,t->tm_mday);
+}
+
+// train referenced by its trainNo id; name/departure come from the timetable
 struct Booking {
-    string pnr, name, trainNo, trainName, classType, departure;
+    string pnr, name;
+    int trainNo;
+    TravelClass classType;
     int age, seatNo, fare;
+    int from, to; // boarding/alighting station ids, -1 = origin/terminus
+    int date;     // journey day number, -1 = undated
 };
 
-// ---------------- SIMPLE DATABASE (NO ADVANCED C++) ----------------
-class Database {
-public:
-    vector<Train> trains;
-    vector<Booking> bookings;
-    map<string,int> seatCapacity;
-    map<string,int> fares;
+// ---------------- SEAT MAP ----------------
+// occupancy for one (train, class) per segment (stop to next stop), so a
+// seat given up at a stop can be resold from there. Segment tree over the
+// segments; per node two seat bitmaps (bit i = seat i+1): cover = booked
+// over the node's whole range, any = booked anywhere inside it. Take,
+// release and range queries touch O(log segments) nodes. A seat is never
+// booked twice on one segment, so every cover bit has one owner.
+struct SeatMap {
+    int capacity=0, segments=1, leaves=1, width=1, used=0; // used = live reservations
+    vector<unsigned long long> cover, any;
+    vector<unsigned long long> pad; // bits past capacity, always taken
+
+    void resize(int cap, int segs) {
+        capacity=cap; segments=max(segs,1); used=0;
+        width=max((cap+63)/64,1);
+        leaves=1;
+        while (leaves<segments) leaves*=2;
+        cover.assign(2*leaves*width,0);
+        any.assign(2*leaves*width,0);
+        pad.assign(width,0);
+        if (cap%64!=0) pad.back()=~0ULL<<(cap%64);
+        if (cap==0) pad[0]=~0ULL;
+    }
 
-    Database() {
-        seatCapacity["1A"]=20; seatCapacity["2A"]=40; seatCapacity["3A"]=60;
-        seatCapacity["3E"]=70; seatCapacity["SL"]=120; seatCapacity["CC"]=80; seatCapacity["2S"]=100;
+    bool validRange(int l, int r) const { return l>=0 && r<=segments && l<r; }
+
+    // out |= seats booked on any segment of [l,r)
+    void booked(int l, int r, unsigned long long *out) const {
+        collect(1,0,leaves,l,r,out);
+        for (int w=0;w<width;w++) out[w]|=pad[w];
+    }
+
+    void collect(int node, int lo, int hi, int l, int r, unsigned long long *out) const {
+        if (r<=lo || hi<=l) return;
+        bool inside=(l<=lo && hi<=r);
+        const unsigned long long *bits=inside ? &any[node*width] : &cover[node*width];
+        for (int w=0;w<width;w++) out[w]|=bits[w];
+        if (inside) return;
+        int mid=(lo+hi)/2;
+        collect(2*node,lo,mid,l,r,out);
+        collect(2*node+1,mid,hi,l,r,out);
+    }
+
+    void mark(int node, int lo, int hi, int l, int r, int w, unsigned long long bit, bool on) {
+        if (r<=lo || hi<=l) return;
+        size_t i=(size_t)node*width+w;
+        if (l<=lo && hi<=r) { if (on) cover[i]|=bit; else cover[i]&=~bit; }
+        else {
+            int mid=(lo+hi)/2;
+            mark(2*node,lo,mid,l,r,w,bit,on);
+            mark(2*node+1,mid,hi,l,r,w,bit,on);
+        }
+        any[i]=cover[i];
+        if (hi-lo>1) any[i]|=any[(size_t)2*node*width+w]|any[(size_t)(2*node+1)*width+w];
+    }
+
+    bool taken(int seat, int l, int r) const {
+        if (seat<1 || seat>capacity || !validRange(l,r)) return true;
+        vector<unsigned long long> occ(width,0);
+        booked(l,r,&occ[0]);
+        return (occ[(seat-1)/64]>>((seat-1)%64))&1;
+    }
+
+    bool take(int seat, int l, int r) {
+        if (taken(seat,l,r)) return false;
+        mark(1,0,leaves,l,r,(seat-1)/64,1ULL<<((seat-1)%64),true);
+        used++;
+        return true;
+    }
+
+    void release(int seat, int l, int r) {
+        if (seat<1 || seat>capacity || !validRange(l,r) || !taken(seat,l,l+1)) return;
+        mark(1,0,leaves,l,r,(seat-1)/64,1ULL<<((seat-1)%64),false);
+        used--;
+    }
+
+    // a seat free on all of [l,r), -1 if none. Seats taken on both
+    // neighbouring segments first, then on one, to keep free runs long.
+    int firstFree(int l, int r) const {
+        if (!validRange(l,r)) return -1;
+        vector<unsigned long long> occ(width,0), before(width,~0ULL), after(width,~0ULL);
+        booked(l,r,&occ[0]);
+        if (l>0) { before.assign(width,0); booked(l-1,l,&before[0]); }
+        if (r<segments) { after.assign(width,0); booked(r,r+1,&after[0]); }
+
+        for (int pass=0;pass<3;pass++)
+            for (int w=0;w<width;w++) {
+                unsigned long long free=~occ[w];
+                if (pass==0) free&=before[w]&after[w];
+                if (pass==1) free&=before[w]|after[w];
+                if (free) return w*64+__builtin_ctzll(free)+1;
+            }
+        return -1;
+    }
+
+    int freeCount(int l, int r) const {
+        if (!validRange(l,r)) return 0;
+        vector<unsigned long long> occ(width,0);
+        booked(l,r,&occ[0]);
+        int n=0;
+        for (int w=0;w<width;w++) n+=__builtin_popcountll(~occ[w]);
+        return n;
+    }
+};
 
-        fares["1A"]=2000; fares["2A"]=1500; fares["3A"]=1100;
-        fares["3E"]=900; fares["SL"]=400; fares["CC"]=700; fares["2S"]=300;
+// ---------------- MAPPED FILE ----------------
+// read-only map of a whole file; empty file = size 0, data NULL
+struct MappedFile {
+    const char *data=NULL;
+    size_t size=0;
+#ifdef _WIN32
+    HANDLE file=INVALID_HANDLE_VALUE, mapping=NULL;
+#else
+    int fd=-1;
+#endif
+
+    MappedFile() {}
+    MappedFile(const MappedFile&)=delete;
+    MappedFile &operator=(const MappedFile&)=delete;
+    ~MappedFile() { close(); }
+
+    bool open(const string &path) {
+        close();
+#ifdef _WIN32
+        file=CreateFileA(path.c_str(),GENERIC_READ,FILE_SHARE_READ|FILE_SHARE_WRITE,
+                         NULL,OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL,NULL);
+        if (file==INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER len;
+        if (!GetFileSizeEx(file,&len)) return false;
+        size=(size_t)len.QuadPart;
+        if (size==0) return true;
+        mapping=CreateFileMappingA(file,NULL,PAGE_READONLY,0,0,NULL);
+        if (mapping==NULL) return false;
+        data=(const char*)MapViewOfFile(mapping,FILE_MAP_READ,0,0,0);
+#else
+        fd=::open(path.c_str(),O_RDONLY);
+        if (fd<0) return false;
+        struct stat st;
+        if (fstat(fd,&st)!=0) return false;
+        size=(size_t)st.st_size;
+        if (size==0) return true;
+        void *p=mmap(NULL,size,PROT_READ,MAP_PRIVATE,fd,0);
+        if (p==MAP_FAILED) return false;
+        data=(const char*)p;
+#endif
+        return data!=NULL;
+    }
 
-        srand((unsigned)time(0));
+    void close() {
+#ifdef _WIN32
+        if (data) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        if (file!=INVALID_HANDLE_VALUE) CloseHandle(file);
+        file=INVALID_HANDLE_VALUE; mapping=NULL;
+#else
+        if (data) munmap((void*)data,size);
+        if (fd>=0) ::close(fd);
+        fd=-1;
+#endif
+        data=NULL; size=0;
     }
+};
 
-    string trim(string s) {
-        size_t a = s.find_first_not_of(" \t\r\n");
-        size_t b = s.find_last_not_of(" \t\r\n");
-        if (a == string::npos) return "";
-        return s.substr(a, b - a + 1);
+// ---------------- APPEND FILE ----------------
+// raw append-only file; unlike ofstream it can be synced to disk
+struct AppendFile {
+    int fd=-1;
+
+    AppendFile() {}
+    AppendFile(const AppendFile&)=delete;
+    AppendFile &operator=(const AppendFile&)=delete;
+    ~AppendFile() { close(); }
+
+    bool isOpen() const { return fd>=0; }
+
+    bool open(const string &path, bool truncate) {
+        close();
+#ifdef _WIN32
+        fd=_open(path.c_str(),_O_WRONLY|_O_CREAT|_O_APPEND|_O_BINARY|(truncate?_O_TRUNC:0),_S_IREAD|_S_IWRITE);
+#else
+        fd=::open(path.c_str(),O_WRONLY|O_CREAT|O_APPEND|(truncate?O_TRUNC:0),0644);
+#endif
+        return fd>=0;
     }
 
-    vector<string> split(string s, char d) {
-        vector<string> out;
-        string temp="";
-        for (int i=0;i<s.size();i++) {
-            if (s[i]==d) { out.push_back(trim(temp)); temp=""; }
-            else temp+=s[i];
+    bool append(const string &data) {
+        size_t done=0;
+        while (done<data.size()) {
+#ifdef _WIN32
+            int n=_write(fd,data.data()+done,(unsigned int)(data.size()-done));
+#else
+            ssize_t n=write(fd,data.data()+done,data.size()-done);
+            if (n<0 && errno==EINTR) continue;
+#endif
+            if (n<=0) return false;
+            done+=n;
+        }
+        return true;
+    }
+
+    bool sync() {
+#ifdef _WIN32
+        return _commit(fd)==0;
+#else
+        return fsync(fd)==0;
+#endif
+    }
+
+    void close() {
+        if (fd<0) return;
+#ifdef _WIN32
+        _close(fd);
+#else
+        ::close(fd);
+#endif
+        fd=-1;
+    }
+};
+
+// ---------------- DURABLE FILES ----------------
+// write <path>.tmp, sync it, rename it over path: a crash leaves the old
+// file or the new one, never a half-written one
+static bool replaceFile(const string &path, const string &data) {
+    string tmp=path+".tmp";
+    AppendFile f;
+    if (!f.open(tmp,true)) return false;
+    bool ok=f.append(data) && f.sync();
+    f.close();
+#ifdef _WIN32
+    if (ok) ok=MoveFileExA(tmp.c_str(),path.c_str(),MOVEFILE_REPLACE_EXISTING|MOVEFILE_WRITE_THROUGH)!=0;
+#else
+    if (ok) ok=rename(tmp.c_str(),path.c_str())==0;
+    if (ok) {
+        // the rename is only durable once the directory is synced too
+        size_t slash=path.rfind('/');
+        string dir=slash==string::npos ? "." : path.substr(0,slash+1);
+        int fd=::open(dir.c_str(),O_RDONLY);
+        if (fd>=0) { fsync(fd); ::close(fd); }
+    }
+#endif
+    if (!ok) remove(tmp.c_str());
+    return ok;
+}
+
+static bool truncateFile(const string &path, long long size) {
+#ifdef _WIN32
+    int fd=_open(path.c_str(),_O_WRONLY|_O_BINARY);
+    if (fd<0) return false;
+    bool ok=_chsize_s(fd,size)==0 && _commit(fd)==0;
+    _close(fd);
+    return ok;
+#else
+    return truncate(path.c_str(),size)==0;
+#endif
+}
+
+// CRC-32 (IEEE) stamped on every journal record
+struct Crc32 {
+    unsigned int table[256];
+    Crc32() {
+        for (unsigned int i=0;i<256;i++) {
+            unsigned int c=i;
+            for (int k=0;k<8;k++) c=(c&1) ? 0xEDB88320u^(c>>1) : c>>1;
+            table[i]=c;
+        }
+    }
+    unsigned int operator()(string_view s) const {
+        unsigned int c=0xFFFFFFFFu;
+        for (size_t i=0;i<s.size();i++) c=table[(c^(unsigned char)s[i])&0xFF]^(c>>8);
+        return c^0xFFFFFFFFu;
+    }
+};
+
+static unsigned int crc32(string_view s) {
+    static const Crc32 crc;
+    return crc(s);
+}
+
+// record + ",~" + its crc in hex
+static string journalLine(const string &record) {
+    char buf[16];
+    snprintf(buf,sizeof(buf),",~%08x\n",crc32(record));
+    return record+buf;
+}
+
+// checks and strips the crc field; lines from before checksums have none
+static bool checkJournalLine(string_view &line) {
+    while (!line.empty() && line.back()=='\r') line.remove_suffix(1);
+    size_t comma=line.rfind(',');
+    if (comma==string_view::npos || comma+1>=line.size() || line[comma+1]!='~') return true;
+    if (line.size()-comma!=10) return false;
+
+    unsigned int stored=0;
+    for (size_t i=comma+2;i<line.size();i++) {
+        char c=line[i];
+        if (c>='0' && c<='9') stored=stored*16+(c-'0');
+        else if (c>='a' && c<='f') stored=stored*16+(c-'a'+10);
+        else return false;
+    }
+    line=line.substr(0,comma);
+    return crc32(line)==stored;
+}
+
+// ---------------- DIRECTORY LOCK ----------------
+// the GUI's own store and bookingd's are separate files, so only one of
+// them may run in a directory: each holds bookings.lock while it runs, and
+// the OS lets go of it if the process dies. A GUI booking through bookingd
+// doesn't take it.
+struct DirectoryLock {
+#ifdef _WIN32
+    HANDLE file=INVALID_HANDLE_VALUE;
+    ~DirectoryLock() { if (file!=INVALID_HANDLE_VALUE) CloseHandle(file); }
+
+    // no sharing, so a second open fails while this one lives
+    bool acquire(const string &path) {
+        file=CreateFileA(path.c_str(),GENERIC_READ|GENERIC_WRITE,0,NULL,OPEN_ALWAYS,FILE_ATTRIBUTE_NORMAL,NULL);
+        return file!=INVALID_HANDLE_VALUE;
+    }
+#else
+    int fd=-1;
+    ~DirectoryLock() { if (fd>=0) ::close(fd); }
+
+    bool acquire(const string &path) {
+        fd=::open(path.c_str(),O_RDWR|O_CREAT,0644);
+        if (fd<0) return false;
+        if (flock(fd,LOCK_EX|LOCK_NB)==0) return true;
+        ::close(fd); fd=-1;
+        return false;
+    }
+#endif
+};
+
+// ---------------- CSV READER ----------------
+// rows of trimmed string_views pointing into the mapped buffer (no copies)
+struct CsvReader {
+    const char *cur, *end;
+    string_view row;    // text of the row next() last returned
+
+    CsvReader(const char *data, size_t size) : cur(data), end(data+size) {}
+
+    static string_view trim(const char *a, const char *b) {
+        while (a<b && (*a==' ' || *a=='\t' || *a=='\r')) a++;
+        while (b>a && (b[-1]==' ' || b[-1]=='\t' || b[-1]=='\r')) b--;
+        return string_view(a,b-a);
+    }
+
+    // next non-blank row, false at the end
+    bool next(vector<string_view> &fields, char d) {
+        while (cur<end) {
+            const char *eol=(const char*)memchr(cur,'\n',end-cur);
+            if (!eol) eol=end;
+            const char *line=cur;
+            cur=(eol==end) ? end : eol+1;
+            row=trim(line,eol);
+            if (row.empty()) continue;
+
+            fields.clear();
+            const char *start=line;
+            for (const char *c=line;c<eol;c++)
+                if (*c==d) { fields.push_back(trim(start,c)); start=c+1; }
+            fields.push_back(trim(start,eol));
+            return true;
+        }
+        return false;
+    }
+
+    // for reserve() before parsing
+    size_t countLines() {
+        size_t n=0;
+        for (const char *c=cur; c<end && (c=(const char*)memchr(c,'\n',end-c)); c++) n++;
+        return n+1;
+    }
+};
+
+// like atoi, but on a field that is not null-terminated
+static int toInt(string_view s) {
+    int v=0;
+    bool neg=!s.empty() && s[0]=='-';
+    for (size_t i=neg?1:0; i<s.size() && s[i]>='0' && s[i]<='9'; i++) v=v*10+(s[i]-'0');
+    return neg ? -v : v;
+}
+
+// ---------------- BINARY SNAPSHOT ----------------
+// SnapshotHeader, then fixed-width records, then a string table the
+// records point into as (offset,length); equal strings are stored once.
+// The header keeps the size+mtime of the csv it came from, so editing or
+// importing the csv makes the snapshot stale and the csv is parsed again.
+static const char SNAPSHOT_MAGIC[8]={'T','R','S','N','A','P','\0','\0'};
+static const unsigned int SNAPSHOT_VERSION=6;
+
+struct SnapshotHeader {
+    char magic[8];
+    unsigned int version, recordSize;
+    long long sourceSize, sourceTime;
+    unsigned long long recordCount, stringBytes;
+};
+
+struct StrRef { unsigned int offset, length; };
+
+struct TrainRecord {
+    StrRef trainNo, trainName, from, to, stop;
+    int arr, dep;
+    unsigned int classes, pad;
+};
+
+struct BookingRecord {
+    StrRef pnr, name, trainNo, from, to;
+    int age, seatNo, fare, classType, date, pad;
+};
+
+static bool fileStamp(const string &path, long long &size, long long &mtime) {
+    struct stat st;
+    if (stat(path.c_str(),&st)!=0) return false;
+    size=st.st_size; mtime=st.st_mtime;
+    return true;
+}
+
+struct SnapshotWriter {
+    string records, strings;
+    unordered_map<string,StrRef> seen;
+    unsigned long long count=0;
+
+    StrRef str(const string &s) {
+        unordered_map<string,StrRef>::iterator it=seen.find(s);
+        if (it!=seen.end()) return it->second;
+        StrRef r; r.offset=strings.size(); r.length=s.size();
+        strings+=s;
+        seen[s]=r;
+        return r;
+    }
+
+    void add(const void *record, size_t size) {
+        records.append((const char*)record,size);
+        count++;
+    }
+
+    // source csv must already be written, its stamp goes in the header
+    bool save(const string &path, const string &source, unsigned int recordSize) {
+        SnapshotHeader h;
+        memset(&h,0,sizeof(h));
+        memcpy(h.magic,SNAPSHOT_MAGIC,8);
+        h.version=SNAPSHOT_VERSION; h.recordSize=recordSize;
+        if (!fileStamp(source,h.sourceSize,h.sourceTime)) return false;
+        h.recordCount=count; h.stringBytes=strings.size();
+
+        string data((const char*)&h,sizeof(h));
+        data+=records; data+=strings;
+        return replaceFile(path,data);
+    }
+};
+
+struct SnapshotReader {
+    MappedFile file;
+    SnapshotHeader header;
+    const char *records=NULL, *strings=NULL;
+
+    // false if missing, damaged, other version or stale against source
+    bool open(const string &path, const string &source, unsigned int recordSize) {
+        long long size, mtime;
+        if (!fileStamp(source,size,mtime)) return false;
+        if (!file.open(path) || file.size<sizeof(header)) return false;
+
+        memcpy(&header,file.data,sizeof(header));
+        if (memcmp(header.magic,SNAPSHOT_MAGIC,8)!=0) return false;
+        if (header.version!=SNAPSHOT_VERSION || header.recordSize!=recordSize) return false;
+        if (header.sourceSize!=size || header.sourceTime!=mtime) return false;
+        if (sizeof(header)+header.recordCount*recordSize+header.stringBytes!=file.size) return false;
+
+        records=file.data+sizeof(header);
+        strings=records+header.recordCount*recordSize;
+        return true;
+    }
+
+    void record(unsigned long long i, void *out) {
+        memcpy(out,records+i*header.recordSize,header.recordSize);
+    }
+
+    string_view str(StrRef r) {
+        if ((unsigned long long)r.offset+r.length>header.stringBytes) return string_view();
+        return string_view(strings+r.offset,r.length);
+    }
+};
+
+// ---------------- NAME SCANNER ----------------
+// one lower-cased string per train in a single "...\n...\n" buffer. find()
+// matches the key's first and last byte 32 (AVX2) / 16 (SSE2) positions at
+// a time and only memcmp's those candidates.
+struct NameScanner {
+    static const int PAD=64;  // zero bytes past the end for the wide loads
+    string text;
+    size_t length;            // text.size() minus PAD
+    vector<size_t> start;     // offset of each string, in train order
+
+    NameScanner() { clear(); }
+
+    void clear() { text.assign(PAD,'\0'); length=0; start.clear(); }
+
+    static char lower(char c) { return (c>='A' && c<='Z') ? c-'A'+'a' : c; }
+
+    void add(string_view name) {
+        text.resize(length);
+        start.push_back(length);
+        for (int i=0;i<name.size();i++) text.push_back(lower(name[i]));
+        text.push_back('\n');
+        length=text.size();
+        text.append(PAD,'\0');
+    }
+
+    int owner(size_t pos) const { return upper_bound(start.begin(),start.end(),pos)-start.begin()-1; }
+
+    // the i-th string without its '\n'
+    string_view entry(int i) const {
+        size_t end=i+1<start.size() ? start[i+1] : length;
+        return string_view(text.data()+start[i],end-start[i]-1);
+    }
+
+    // first pos in [i,last] with text[pos]==a and text[pos+k-1]==b
+    size_t candidate(size_t i, size_t last, size_t k, char a, char b) const {
+        const char *s=text.data();
+#if defined(__AVX2__)
+        __m256i wa=_mm256_set1_epi8(a), wb=_mm256_set1_epi8(b);
+        for (;i+32<=last+1;i+=32) {
+            __m256i x=_mm256_cmpeq_epi8(wa,_mm256_loadu_si256((const __m256i*)(s+i)));
+            __m256i y=_mm256_cmpeq_epi8(wb,_mm256_loadu_si256((const __m256i*)(s+i+k-1)));
+            unsigned int m=_mm256_movemask_epi8(_mm256_and_si256(x,y));
+            if (m) return i+__builtin_ctz(m);
+        }
+#elif defined(__SSE2__)
+        __m128i wa=_mm_set1_epi8(a), wb=_mm_set1_epi8(b);
+        for (;i+16<=last+1;i+=16) {
+            __m128i x=_mm_cmpeq_epi8(wa,_mm_loadu_si128((const __m128i*)(s+i)));
+            __m128i y=_mm_cmpeq_epi8(wb,_mm_loadu_si128((const __m128i*)(s+i+k-1)));
+            unsigned int m=_mm_movemask_epi8(_mm_and_si128(x,y));
+            if (m) return i+__builtin_ctz(m);
+        }
+#endif
+        for (;i<=last;i++) if (s[i]==a && s[i+k-1]==b) return i;
+        return string::npos;
+    }
+
+    // indices of strings containing key, case-insensitive, ascending
+    vector<int> find(string_view key) const {
+        vector<int> out;
+        string low;
+        for (int i=0;i<key.size();i++) {
+            if (key[i]=='\n') return out;
+            low.push_back(lower(key[i]));
+        }
+        if (low.empty()) {
+            for (int i=0;i<start.size();i++) out.push_back(i);
+            return out;
+        }
+        if (low.size()>length) return out;
+
+        size_t k=low.size(), last=length-k, i=0;
+        while (i<=last) {
+            size_t pos=candidate(i,last,k,low[0],low[k-1]);
+            if (pos==string::npos) break;
+            if (memcmp(text.data()+pos,low.data(),k)==0) {
+                int t=owner(pos);
+                out.push_back(t);
+                if (t+1>=start.size()) break;
+                i=start[t+1];   // one hit per string
+            } else i=pos+1;
         }
-        out.push_back(trim(temp));
         return out;
     }
+};
+
+// ---------------- TRIGRAM INDEX ----------------
+// lower-cased 3-byte gram -> ascending train positions whose name or
+// stations contain it. Keys of 3+ bytes only check the intersection of their
+// grams' lists; shorter keys are scanned for in every train.
+struct TrigramIndex {
+    NameScanner docs;     // "name\nfrom\nto" per train
+    unordered_map<unsigned int,vector<int> > postings;
+
+    void clear() { docs.clear(); postings.clear(); }
+
+    static unsigned int gram(const char *s) {
+        return ((unsigned char)s[0]<<16)|((unsigned char)s[1]<<8)|(unsigned char)s[2];
+    }
 
+    void add(string_view name, string_view from, string_view to) {
+        int t=docs.start.size();
+        string doc;
+        for (int i=0;i<name.size();i++) doc.push_back(NameScanner::lower(name[i]));
+        doc.push_back('\n');
+        for (int i=0;i<from.size();i++) doc.push_back(NameScanner::lower(from[i]));
+        doc.push_back('\n');
+        for (int i=0;i<to.size();i++) doc.push_back(NameScanner::lower(to[i]));
+
+        for (int i=0;i+3<=(int)doc.size();i++) {
+            vector<int> &list=postings[gram(doc.data()+i)];
+            if (list.empty() || list.back()!=t) list.push_back(t); // added in order
+        }
+        docs.add(doc);
+    }
+
+    vector<int> find(string_view key) const {
+        vector<int> out;
+        string low;
+        for (int i=0;i<key.size();i++) {
+            if (key[i]=='\n') return out;
+            low.push_back(NameScanner::lower(key[i]));
+        }
+        if (low.size()<3) return docs.find(low);
+
+        vector<const vector<int>*> lists;
+        for (int i=0;i+3<=(int)low.size();i++) {
+            auto it=postings.find(gram(low.data()+i));
+            if (it==postings.end()) return out;
+            lists.push_back(&it->second);
+        }
+        sort(lists.begin(),lists.end(),[](const vector<int> *a, const vector<int> *b){ return a->size()<b->size(); });
+
+        // intersect, shortest list first
+        vector<int> cand=*lists[0];
+        for (int i=1;i<lists.size() && !cand.empty();i++) {
+            if (lists[i]==lists[i-1]) continue;
+            const vector<int> &other=*lists[i];
+            auto pos=other.begin();
+            int kept=0;
+            for (int j=0;j<cand.size();j++) {
+                pos=lower_bound(pos,other.end(),cand[j]);
+                if (pos==other.end()) break;
+                if (*pos==cand[j]) cand[kept++]=cand[j];
+            }
+            cand.resize(kept);
+        }
+
+        // grams may match out of order or across fields
+        for (int i=0;i<cand.size();i++) if (docs.entry(cand[i]).find(low)!=string_view::npos) out.push_back(cand[i]);
+        return out;
+    }
+};
+
+// ---------------- PNR GENERATOR ----------------
+// 10-digit PNR = FIRST + permute(seq). permute is a 34-bit Feistel network
+// cycle-walked into [0,SPACE), i.e. a bijection, so a new sequence number
+// always gives a new PNR without searching the bookings. Old 6-digit
+// PNRs are shorter and can't clash. The GUI counts in the upper half of the
+// sequence numbers and bookingd in the lower, so they never issue the same
+// PNR.
+struct PnrGenerator {
+    static const unsigned long long FIRST=1000000000ULL;
+    static const unsigned long long SPACE=9000000000ULL;
+    static const unsigned long long LOW=SPACE/2, HIGH=SPACE;  // this program's [LOW,HIGH)
+    static const int HALF_BITS=17;
+    static const unsigned int HALF_MASK=(1u<<HALF_BITS)-1;
+
+    atomic<unsigned long long> next{LOW};
+
+    unsigned int round(unsigned int half, int r) {
+        static const unsigned int keys[4]={0x9E3779B9u,0x7F4A7C15u,0x85EBCA6Bu,0xC2B2AE35u};
+        unsigned int x=(half^keys[r])*0x2C1B3C6Du;
+        x^=x>>15;
+        return x&HALF_MASK;
+    }
+
+    unsigned long long feistel(unsigned long long v) {
+        unsigned int l=(unsigned int)(v>>HALF_BITS)&HALF_MASK, r=(unsigned int)v&HALF_MASK;
+        for (int i=0;i<4;i++) { unsigned int t=l^round(r,i); l=r; r=t; }
+        return ((unsigned long long)l<<HALF_BITS)|r;
+    }
+
+    unsigned long long unfeistel(unsigned long long v) {
+        unsigned int l=(unsigned int)(v>>HALF_BITS)&HALF_MASK, r=(unsigned int)v&HALF_MASK;
+        for (int i=3;i>=0;i--) { unsigned int t=r^round(l,i); r=l; l=t; }
+        return ((unsigned long long)l<<HALF_BITS)|r;
+    }
+
+    unsigned long long permute(unsigned long long seq) {
+        do seq=feistel(seq); while (seq>=SPACE);
+        return seq;
+    }
+
+    unsigned long long unpermute(unsigned long long v) {
+        do v=unfeistel(v); while (v>=SPACE);
+        return v;
+    }
+
+    // thread-safe; "" once the range is used
+    string make() {
+        unsigned long long seq=next.fetch_add(1);
+        if (seq>=HIGH) return "";
+        return to_string(FIRST+permute(seq));
+    }
+
+    // never backwards; bookingd's numbers are ignored
+    void skipTo(unsigned long long n) {
+        if (n<=LOW || n>HIGH) return;
+        unsigned long long cur=next.load();
+        while (cur<n && !next.compare_exchange_weak(cur,n)) {}
+    }
+
+    // keep the sequence ahead of a pnr read from disk
+    void observe(const string &pnr) {
+        if (pnr.size()!=10 || pnr[0]=='0') return;
+        for (int i=0;i<10;i++) if (pnr[i]<'0' || pnr[i]>'9') return;
+        skipTo(unpermute(strtoull(pnr.c_str(),NULL,10)-FIRST)+1);
+    }
+};
+
+// ---------------- BOOKING STORE ----------------
+// one vector per field so counts/revenue/occupancy scans only read the
+// columns they need. rows are slots: cancel tombstones a slot (live=0)
+// and freeSlots hands it out again, so other bookings never move
+struct BookingStore {
+    vector<string> pnr, name;
+    vector<int> age, trainNo, seatNo, fare, from, to, date;
+    vector<unsigned char> classType;
+    vector<char> live;
+
+    vector<int> freeSlots;
+    int liveCount=0;
+    unordered_multimap<string,int> pnrIndex; // pnr -> slot (old files may repeat a pnr)
+
+    int slots() const { return live.size(); }
+
+    void clear() {
+        pnr.clear(); name.clear(); age.clear(); trainNo.clear();
+        seatNo.clear(); fare.clear(); from.clear(); to.clear(); date.clear(); classType.clear(); live.clear();
+        freeSlots.clear(); pnrIndex.clear();
+        liveCount=0;
+    }
+
+    void reserve(size_t n) {
+        pnr.reserve(n); name.reserve(n); age.reserve(n); trainNo.reserve(n);
+        seatNo.reserve(n); fare.reserve(n); from.reserve(n); to.reserve(n); date.reserve(n); classType.reserve(n); live.reserve(n);
+        pnrIndex.reserve(n);
+    }
+
+    int insert(const Booking &b) {
+        int slot;
+        if (!freeSlots.empty()) { slot=freeSlots.back(); freeSlots.pop_back(); }
+        else {
+            slot=live.size();
+            pnr.push_back(""); name.push_back(""); age.push_back(0); trainNo.push_back(-1);
+            seatNo.push_back(0); fare.push_back(0); from.push_back(-1); to.push_back(-1); date.push_back(-1);
+            classType.push_back(0); live.push_back(0);
+        }
+        pnr[slot]=b.pnr; name[slot]=b.name; age[slot]=b.age; trainNo[slot]=b.trainNo;
+        seatNo[slot]=b.seatNo; fare[slot]=b.fare; from[slot]=b.from; to[slot]=b.to; date[slot]=b.date; classType[slot]=b.classType;
+        live[slot]=1;
+        liveCount++;
+        pnrIndex.insert(make_pair(b.pnr,slot));
+        return slot;
+    }
+
+    Booking get(int slot) const {
+        Booking b;
+        b.pnr=pnr[slot]; b.name=name[slot]; b.age=age[slot]; b.trainNo=trainNo[slot];
+        b.seatNo=seatNo[slot]; b.fare=fare[slot]; b.classType=(TravelClass)classType[slot];
+        b.from=from[slot]; b.to=to[slot]; b.date=date[slot];
+        return b;
+    }
+
+    // some slot with this pnr, -1 if none
+    int find(const string &p) const {
+        unordered_multimap<string,int>::const_iterator it=pnrIndex.find(p);
+        return it==pnrIndex.end() ? -1 : it->second;
+    }
+
+    void remove(int slot) {
+        pair<unordered_multimap<string,int>::iterator,
+             unordered_multimap<string,int>::iterator> r=pnrIndex.equal_range(pnr[slot]);
+        for (unordered_multimap<string,int>::iterator it=r.first;it!=r.second;it++)
+            if (it->second==slot) { pnrIndex.erase(it); break; }
+
+        pnr[slot]=string(); name[slot]=string(); trainNo[slot]=-1;
+        live[slot]=0;
+        liveCount--;
+        freeSlots.push_back(slot);
+    }
+};
+
+// ---------------- JOURNAL WRITER ----------------
+// Journal lines are queued here and a thread appends and syncs them, so the
+// frame loop never waits on the disk. Everything queued since the last
+// write goes out with one append + one sync. The queue is bounded: when it
+// is full, push() refuses instead of blocking a frame.
+//
+// Lines stay queued until they are synced. A failed batch is cut off the
+// file again and retried after RETRY_DELAY, so a torn line never sits in
+// front of later records.
+struct JournalWriter {
+    static const size_t CAPACITY=256;
+    static constexpr chrono::milliseconds RETRY_DELAY{1000};
+
+    string path;
+    deque<string> queue;                         // lines not synced yet
+    unsigned long long queued=0;                 // lines ever queued
+    atomic<unsigned long long> committed{0};     // lines ever synced
+    atomic<bool> failed{false};                  // the last write or sync failed
+    bool stopping=false;
+    // a fold handed over by fold(): runs once every line queued before it
+    // is written, then the journal is emptied
+    bool foldPending=false;
+    unsigned long long foldAt=0;
+    function<bool()> foldSave;
+    mutex lock;
+    condition_variable wake, written;
+    thread worker;
+
+    // owned by whoever holds fileLock (the worker, or markSaved)
+    mutex fileLock;
+    AppendFile f;
+    long long goodBytes=0;   // file size up to the last synced batch
+    bool torn=false;         // bytes past goodBytes must be cut off first
+
+    JournalWriter(const string &p) : path(p) { worker=thread(&JournalWriter::run,this); }
+    JournalWriter(const JournalWriter&)=delete;
+    JournalWriter &operator=(const JournalWriter&)=delete;
+
+    // queued lines are written before the thread ends
+    ~JournalWriter() {
+        { lock_guard<mutex> lk(lock); stopping=true; }
+        wake.notify_one();
+        worker.join();
+    }
+
+    bool full() {
+        lock_guard<mutex> lk(lock);
+        return queue.size()>=CAPACITY;
+    }
+
+    // seq = the line's number, committed once `committed` reaches it
+    bool push(const string &line, unsigned long long &seq) {
+        {
+            lock_guard<mutex> lk(lock);
+            if (queue.size()>=CAPACITY) return false;
+            queue.push_back(line);
+            seq=++queued;
+        }
+        wake.notify_one();
+        return true;
+    }
+
+    bool isCommitted(unsigned long long seq) const { return committed.load()>=seq; }
+
+    unsigned long long backlog() {
+        lock_guard<mutex> lk(lock);
+        return queued-committed.load();
+    }
+
+    // blocks until everything queued so far is written (or failed)
+    void drain() {
+        unique_lock<mutex> lk(lock);
+        written.wait(lk,[this]{ return (committed.load()>=queued && !foldPending) || failed.load(); });
+    }
+
+    bool folding() {
+        lock_guard<mutex> lk(lock);
+        return foldPending;
+    }
+
+    // save() puts the journal's content on disk some other way; it runs on
+    // the worker after the lines queued so far, and the journal is emptied
+    // if it succeeds. Lines queued later wait for it. One fold at a time.
+    bool fold(function<bool()> save) {
+        {
+            lock_guard<mutex> lk(lock);
+            if (foldPending) return false;
+            foldPending=true;
+            foldAt=queued;
+            foldSave=move(save);
+        }
+        wake.notify_one();
+        return true;
+    }
+
+    // the journal's content is now on disk some other way (compaction):
+    // empty the file and drop the lines (and any fold) still waiting for it
+    bool markSaved() {
+        lock_guard<mutex> io(fileLock);
+        if (!f.open(path,true)) return false;
+        goodBytes=0;
+        torn=false;
+        lock_guard<mutex> lk(lock);
+        queue.clear();
+        committed=queued;
+        failed=false;
+        foldPending=false;
+        foldSave=nullptr;
+        return true;
+    }
+
+    // appends data right after the last synced batch
+    bool writeBatch(const string &data) {
+        if (torn) {
+            f.close();
+            if (!truncateFile(path,goodBytes)) return false;
+            torn=false;
+        }
+        if (!f.isOpen()) {
+            long long mtime;
+            if (!f.open(path,false)) return false;
+            if (!fileStamp(path,goodBytes,mtime)) { f.close(); return false; }
+        }
+        if (f.append(data) && f.sync()) {
+            goodBytes+=data.size();
+            return true;
+        }
+        // part of it may be in the file; a fresh descriptor cuts it off
+        f.close();
+        torn=true;
+        return false;
+    }
+
+    void run() {
+        while (true) {
+            {
+                unique_lock<mutex> lk(lock);
+                if (failed) wake.wait_for(lk,RETRY_DELAY,[this]{ return stopping; });
+                wake.wait(lk,[this]{ return !queue.empty() || foldPending || stopping; });
+                if (queue.empty() && !foldPending) return;
+            }
+
+            lock_guard<mutex> io(fileLock);
+            string data;
+            size_t lines;
+            unsigned long long upto;
+            {
+                lock_guard<mutex> lk(lock);
+                if (queue.empty() && !foldPending) continue;   // compaction saved them meanwhile
+                // a pending fold only lets the lines before it through
+                lines=queue.size();
+                if (foldPending) lines=min<unsigned long long>(lines,foldAt>committed ? foldAt-committed : 0);
+                for (size_t i=0;i<lines;i++) data+=queue[i];
+                upto=committed+lines;
+            }
+
+            bool ok=lines==0 || writeBatch(data);
+            bool giveUp;
+            {
+                lock_guard<mutex> lk(lock);
+                if (ok) {
+                    queue.erase(queue.begin(),queue.begin()+lines);
+                    committed=upto;
+                }
+                failed=!ok;
+                giveUp=!ok && stopping;
+            }
+            if (ok) runFold();
+            written.notify_all();
+            if (giveUp) return;
+        }
+    }
+
+    // with fileLock held, once the lines before the fold are written. If
+    // save() fails the journal still has every line, so nothing is lost;
+    // the fold is dropped and the next one covers these lines too.
+    void runFold() {
+        function<bool()> save;
+        {
+            lock_guard<mutex> lk(lock);
+            if (!foldPending || committed.load()<foldAt) return;
+            save=move(foldSave);
+        }
+        if (save() && f.open(path,true)) {
+            goodBytes=0;
+            torn=false;
+        }
+        lock_guard<mutex> lk(lock);
+        foldPending=false;
+        foldSave=nullptr;
+    }
+};
+
+// ---------------- BOOKING IMAGE ----------------
+// one bookings.csv row. trainName/departure are only there for people
+// reading the file: blank if the train left the timetable
+static string bookingCsvLine(const Booking &b, const string &trainNo, const string &trainName,
+                             int dep, const string &from, const string &to) {
+    stringstream ss;
+    ss<<b.pnr<<","<<b.name<<","<<b.age<<","<<trainNo<<","<<trainName<<","<<CLASS_CODES[b.classType]<<","
+      <<b.seatNo<<","<<b.fare<<","<<(dep>=0 ? formatTime(dep) : "")<<","
+      <<from<<","<<to<<","<<formatDate(b.date);
+    return ss.str();
+}
+
+// the live bookings plus every name their ids need, copied out of the
+// Database so bookings.csv and bookings.bin can be built from it on the
+// journal writer's thread while the UI keeps changing the store
+struct BookingImage {
+    vector<Booking> rows;
+    vector<string> text;    // StringPool id -> string
+    vector<int> trainName;  // by trainNo id, -1 if not in the timetable
+    vector<int> dep;        // by trainNo id, -1 if unknown
+
+    const string &str(int id) const {
+        static const string blank;
+        return id<0 ? blank : text[id];
+    }
+
+    string csv() const {
+        string data="pnr,name,age,trainNo,trainName,classType,seatNo,fare,departure,from,to,date\n";
+        for (int i=0;i<rows.size();i++) {
+            const Booking &b=rows[i];
+            data+=bookingCsvLine(b,str(b.trainNo),str(trainName[b.trainNo]),dep[b.trainNo],str(b.from),str(b.to));
+            data+='\n';
+        }
+        return data;
+    }
+
+    SnapshotWriter snapshot() const {
+        SnapshotWriter snap;
+        for (int i=0;i<rows.size();i++) {
+            const Booking &b=rows[i];
+            BookingRecord r;
+            r.pnr=snap.str(b.pnr); r.name=snap.str(b.name);
+            r.trainNo=snap.str(str(b.trainNo));
+            r.from=snap.str(str(b.from)); r.to=snap.str(str(b.to));
+            r.age=b.age; r.seatNo=b.seatNo;
+            r.fare=b.fare; r.classType=b.classType;
+            r.date=b.date; r.pad=0;
+            snap.add(&r,sizeof(r));
+        }
+        return snap;
+    }
+};
+
+// ---------------- SIMPLE DATABASE (NO ADVANCED C++) ----------------
+class Database {
+public:
+    vector<Train> trains;
+    BookingStore bookings;
+    StringPool pool;       // never cleared, so booking ids survive a Reload
+    vector<int> trainIndex; // trainNo id -> position in trains, -1 if none
+    TrigramIndex grams;     // name + station trigrams for search
+    unordered_map<unsigned long long,vector<int> > routes; // (from,to) ids -> train positions by departure
+    vector<int> departures; // train positions with a known departure, by departure
+    // all calls back to back, train i owns stops[stopStart[i]..stopStart[i+1])
+    vector<Stop> stops;
+    vector<int> stopStart;
+    // same calls by station id as (train, stop index), sorted
+    vector<int> callStart;
+    vector<pair<int,int> > stationCalls;
+    // (date, trainNo id) -> one SeatMap per class; made on first use,
+    // dropped when the date is archived
+    unordered_map<unsigned long long,vector<SeatMap> > seatMaps;
+    int bookingHorizon=120; // days ahead a new booking may be made
+    int timetableVersion=0; // bumped by loadTrains(); results holding train positions are stale after it
+    int seatCapacity[CLASS_COUNT];
+    int fares[CLASS_COUNT];
+
+    // append-only add/cancel log, written in the background. compact()
+    // folds it into bookings.csv at start and exit; in between the writer
+    // thread does every compactEvery records (foldJournal()), so no frame
+    // waits for a full rewrite
+    JournalWriter writer{"bookings.journal"};
+    int journalRecords=0;   // in the journal since the last fold
+    int compactEvery=1000;
+    // pnr -> writer seq of its latest record, for bookings made this session
+    unordered_map<string,unsigned long long> journalSeq;
+
+    // csv rows that don't parse (e.g. an unknown class code), moved to
+    // bookings.rejects by the next compaction rather than dropped
+    vector<string> rejected;
+
+    PnrGenerator pnrGen;
+
+    Database() {
+        seatCapacity[CLASS_1A]=20; seatCapacity[CLASS_2A]=40; seatCapacity[CLASS_3A]=60;
+        seatCapacity[CLASS_3E]=70; seatCapacity[CLASS_SL]=120; seatCapacity[CLASS_CC]=80; seatCapacity[CLASS_2S]=100;
+
+        fares[CLASS_1A]=2000; fares[CLASS_2A]=1500; fares[CLASS_3A]=1100;
+        fares[CLASS_3E]=900; fares[CLASS_SL]=400; fares[CLASS_CC]=700; fares[CLASS_2S]=300;
+    }
+
+    // trains.bin if it still matches trains.csv, else parse and refresh it
     bool loadTrains() {
+        timetableVersion++;
         trains.clear();
-        ifstream f("trains.csv");
-        if (!f.is_open()) return false;
+        trainIndex.clear();
+        grams.clear();
+        routes.clear();
+        departures.clear();
+        if (!loadTrainSnapshot() && !loadTrainCsv()) return false;
+        loadStops();
+        buildDepartureIndex();
+        if (bookings.liveCount>0) rebuildSeatMaps();
+        return true;
+    }
 
-        string line;
-        getline(f,line); // skip header
+    bool loadTrainCsv() {
+        MappedFile f;
+        if (!f.open("trains.csv")) return false;
 
-        while(getline(f,line)) {
-            if (line=="") continue;
+        CsvReader csv(f.data,f.size);
+        trains.reserve(csv.countLines());
 
-            vector<string> p = split(line, ',');
+        vector<string_view> p;
+        csv.next(p,','); // skip header
+
+        while(csv.next(p,',')) {
             if (p.size()<8) continue;
 
             Train t;
-            t.trainNo=p[0]; t.trainName=p[1]; t.from=p[2]; t.to=p[3];
-            t.arr=p[4]; t.dep=p[5]; t.stop=p[6];
+            t.trainNo=pool.intern(p[0]); t.trainName=pool.intern(p[1]);
+            t.from=pool.intern(p[2]); t.to=pool.intern(p[3]);
+            t.arr=parseTime(p[4]); t.dep=parseTime(p[5]); t.stop=p[6];
+            t.classes=parseClassList(p[7]);
 
-            stringstream ss(p[7]);
-            string c;
-            while (ss>>c) t.classes.insert(c);
+            addTrain(t);
+        }
+        f.close();
 
-            trains.push_back(t);
+        saveTrainSnapshot();
+        return true;
+    }
+
+    // stops.csv: "Train No,Station,Arrival,Departure" per call, in running
+    // order. Trains without rows get two calls from their From/To columns.
+    void loadStops() {
+        stops.clear(); stopStart.clear(); callStart.clear(); stationCalls.clear();
+
+        vector<pair<int,Stop> > rows; // (train position, call), file order
+        MappedFile f;
+        if (f.open("stops.csv")) {
+            CsvReader csv(f.data,f.size);
+            rows.reserve(csv.countLines());
+            vector<string_view> p;
+            csv.next(p,','); // skip header
+            while(csv.next(p,',')) {
+                if (p.size()<4) continue;
+                int id=pool.find(p[0]);
+                if (id<0 || id>=trainIndex.size() || trainIndex[id]<0) continue;
+                Stop s;
+                s.station=pool.intern(p[1]); s.arr=parseTime(p[2]); s.dep=parseTime(p[3]);
+                rows.push_back(make_pair(trainIndex[id],s));
+            }
+            f.close();
+        }
+        stable_sort(rows.begin(),rows.end(),[](const pair<int,Stop> &a, const pair<int,Stop> &b){ return a.first<b.first; });
+
+        stops.reserve(rows.size()+2*trains.size());
+        int r=0;
+        for (int i=0;i<trains.size();i++) {
+            stopStart.push_back(stops.size());
+            if (r<rows.size() && rows[r].first==i) {
+                while (r<rows.size() && rows[r].first==i) stops.push_back(rows[r++].second);
+                continue;
+            }
+            Stop a, b;
+            a.station=trains[i].from; a.arr=-1; a.dep=trains[i].dep;
+            b.station=trains[i].to; b.arr=trains[i].arr; b.dep=-1;
+            stops.push_back(a); stops.push_back(b);
+        }
+        stopStart.push_back(stops.size());
+
+        // counting sort by station, filled in train order
+        callStart.assign(pool.size()+1,0);
+        for (int i=0;i<stops.size();i++) callStart[stops[i].station+1]++;
+        for (int s=0;s<pool.size();s++) callStart[s+1]+=callStart[s];
+        stationCalls.resize(stops.size());
+        vector<int> fill(callStart.begin(),callStart.end()-1);
+        for (int i=0;i<trains.size();i++)
+            for (int k=0;k<stopCount(i);k++)
+                stationCalls[fill[stopOf(i,k).station]++]=make_pair(i,k);
+    }
+
+    void buildDepartureIndex() {
+        departures.clear();
+        for (int i=0;i<trains.size();i++) if (trains[i].dep>=0) departures.push_back(i);
+        stable_sort(departures.begin(),departures.end(),[this](int a, int b){ return trains[a].dep<trains[b].dep; });
+    }
+
+    int stopCount(int train) const { return stopStart[train+1]-stopStart[train]; }
+    const Stop &stopOf(int train, int k) const { return stops[stopStart[train]+k]; }
+
+    // "1A 2A CC" -> bitmask, unknown codes dropped
+    unsigned int parseClassList(string_view list) {
+        unsigned int mask=0;
+        vector<string_view> codes;
+        CsvReader csv(list.data(),list.size());
+        while (csv.next(codes,' '))
+            for (int i=0;i<codes.size();i++) {
+                TravelClass c=classFromCode(codes[i]);
+                if (c!=CLASS_COUNT) mask|=classBit(c);
+            }
+        return mask;
+    }
+
+    void addTrain(const Train &t) {
+        grams.add(pool.str(t.trainName),pool.str(t.from),pool.str(t.to));
+        if (t.trainNo>=trainIndex.size()) trainIndex.resize(t.trainNo+1,-1);
+        if (trainIndex[t.trainNo]<0) trainIndex[t.trainNo]=trains.size();
+
+        vector<int> &r=routes[routeKey(t.from,t.to)];
+        r.insert(upper_bound(r.begin(),r.end(),t.dep,[this](int dep, int i){ return dep<trains[i].dep; }),(int)trains.size());
+        trains.push_back(t);
+    }
+
+    static unsigned long long routeKey(int from, int to) {
+        return ((unsigned long long)(unsigned int)from<<32)|(unsigned int)to;
+    }
+
+    bool loadTrainSnapshot() {
+        SnapshotReader snap;
+        if (!snap.open("trains.bin","trains.csv",sizeof(TrainRecord))) return false;
+
+        trains.reserve(snap.header.recordCount);
+
+        for (unsigned long long i=0;i<snap.header.recordCount;i++) {
+            TrainRecord r;
+            snap.record(i,&r);
+
+            Train t;
+            t.trainNo=pool.intern(snap.str(r.trainNo)); t.trainName=pool.intern(snap.str(r.trainName));
+            t.from=pool.intern(snap.str(r.from)); t.to=pool.intern(snap.str(r.to));
+            t.arr=r.arr; t.dep=r.dep; t.stop=snap.str(r.stop);
+            t.classes=r.classes;
+            addTrain(t);
         }
         return true;
     }
 
+    bool saveTrainSnapshot() {
+        SnapshotWriter snap;
+        for (int i=0;i<trains.size();i++) {
+            Train &t=trains[i];
+
+            TrainRecord r;
+            r.trainNo=snap.str(pool.str(t.trainNo)); r.trainName=snap.str(pool.str(t.trainName));
+            r.from=snap.str(pool.str(t.from)); r.to=snap.str(pool.str(t.to));
+            r.arr=t.arr; r.dep=t.dep; r.stop=snap.str(t.stop);
+            r.classes=t.classes; r.pad=0;
+            snap.add(&r,sizeof(r));
+        }
+        return snap.save("trains.bin","trains.csv",sizeof(TrainRecord));
+    }
+
     bool loadBookings() {
+        writer.drain();     // queued records belong in the journal about to be read
         bookings.clear();
-        ifstream f("bookings.csv");
-        if (!f.is_open()) return true;
+        seatMaps.clear();
+        rejected.clear();
+        loadPnrSequence();
 
-        string line;
-        getline(f,line); // skip header
+        MappedFile f;
+        if (loadBookingSnapshot()) {
+            // bookings.bin matches bookings.csv, no parsing needed
+        }
+        else if (f.open("bookings.csv")) {
+            CsvReader csv(f.data,f.size);
+            bookings.reserve(csv.countLines());
 
-        while(getline(f,line)) {
-            if (line=="") continue;
-            vector<string> p = split(line, ',');
-            if (p.size()<9) continue;
+            vector<string_view> p;
+            csv.next(p,','); // skip header
+
+            while(csv.next(p,',')) {
+                Booking b;
+                if (!parseBooking(p,0,b)) { rejected.push_back(string(csv.row)); continue; }
+                loadBooking(b);
+            }
+        }
+        f.close();
+
+        replayJournal();
+        return true;
+    }
+
+    bool loadBookingSnapshot() {
+        SnapshotReader snap;
+        if (!snap.open("bookings.bin","bookings.csv",sizeof(BookingRecord))) return false;
+
+        // an unknown class means a damaged .bin or another build's: parse
+        // the csv instead, which keeps such rows in bookings.rejects
+        unsigned long long n=snap.header.recordCount;
+        for (unsigned long long i=0;i<n;i++) {
+            BookingRecord r;
+            snap.record(i,&r);
+            if (r.classType<0 || r.classType>=CLASS_COUNT) return false;
+        }
+        bookings.reserve(n);
+
+        for (unsigned long long i=0;i<n;i++) {
+            BookingRecord r;
+            snap.record(i,&r);
 
             Booking b;
-            b.pnr=p[0]; b.name=p[1]; b.age=atoi(p[2].c_str());
-            b.trainNo=p[3]; b.trainName=p[4]; b.classType=p[5];
-            b.seatNo=atoi(p[6].c_str()); b.fare=atoi(p[7].c_str());
-            b.departure=p[8];
+            b.pnr=snap.str(r.pnr); b.name=snap.str(r.name); b.age=r.age;
+            b.trainNo=pool.intern(snap.str(r.trainNo));
+            b.classType=(TravelClass)r.classType; b.seatNo=r.seatNo; b.fare=r.fare;
+            b.from=stationId(snap.str(r.from)); b.to=stationId(snap.str(r.to)); b.date=r.date;
+            loadBooking(b);
+        }
+        return true;
+    }
+
+    // written right after bookings.csv so both describe the same state
+    bool saveBookingSnapshot(const BookingImage &image) {
+        return image.snapshot().save("bookings.bin","bookings.csv",sizeof(BookingRecord));
+    }
 
-            bookings.push_back(b);
+    BookingImage bookingImage() {
+        BookingImage image;
+        image.rows.reserve(bookings.liveCount);
+        for (int i=0;i<bookings.slots();i++)
+            if (bookings.live[i]) image.rows.push_back(bookings.get(i));
+        image.text.assign(pool.values.begin(),pool.values.end());
+        image.trainName.assign(pool.size(),-1);
+        image.dep.assign(pool.size(),-1);
+        for (int id=0;id<pool.size();id++) {
+            const Train *t=findById(id);
+            if (t) { image.trainName[id]=t->trainName; image.dep[id]=t->dep; }
         }
+        return image;
+    }
+
+    // rows from before from/to/date existed ride the whole run, undated
+    bool parseBooking(const vector<string_view> &p, int k, Booking &b) {
+        if ((int)p.size()<k+9) return false;
+        b.pnr=p[k]; b.name=p[k+1]; b.age=toInt(p[k+2]);
+        b.trainNo=pool.intern(p[k+3]);
+        b.classType=classFromCode(p[k+5]);
+        if (b.classType==CLASS_COUNT) return false;
+        b.seatNo=toInt(p[k+6]); b.fare=toInt(p[k+7]);
+        b.from=(int)p.size()>k+9 ? stationId(p[k+9]) : -1;
+        b.to=(int)p.size()>k+10 ? stationId(p[k+10]) : -1;
+        b.date=(int)p.size()>k+11 ? parseDate(p[k+11]) : -1;
+        return true;
+    }
+
+    // blank <-> -1 (the train's own origin/terminus)
+    int stationId(string_view name) { return name.empty() ? -1 : pool.intern(name); }
+    string stationName(int id) { return id<0 ? string() : pool.str(id); }
+
+    string bookingLine(const Booking &b) {
+        const Train *t=trainOf(b);
+        return bookingCsvLine(b,pool.str(b.trainNo),t ? pool.str(t->trainName) : "",t ? t->dep : -1,
+                              stationName(b.from),stationName(b.to));
+    }
+
+    // "A,<booking>" = add, "C,<pnr>" = cancel. Stops at the first line that
+    // is unterminated (crash mid-append) or fails its crc and cuts the file
+    // back to there. A re-add of a loaded pnr is skipped, so a journal left
+    // behind by a compact() interrupted after the csv was replaced is harmless.
+    void replayJournal() {
+        journalRecords=0;
+        MappedFile f;
+        if (!f.open("bookings.journal")) return;
+
+        size_t good=0;
+        vector<string_view> p;
+        while (good<f.size) {
+            const char *start=f.data+good;
+            const char *eol=(const char*)memchr(start,'\n',f.size-good);
+            if (!eol) break;
+            string_view line(start,eol-start);
+            if (!checkJournalLine(line)) break;
+            good=eol+1-f.data;
+
+            CsvReader csv(line.data(),line.size());
+            if (!csv.next(p,',')) continue;
+            if (p[0]=="A") {
+                Booking b;
+                if (!parseBooking(p,1,b)) continue;
+                if (bookings.find(b.pnr)>=0) continue;
+                loadBooking(b);
+            }
+            else if (p[0]=="C" && p.size()>=2) {
+                string pnr(p[1]);
+                removeBooking(pnr); pnrGen.observe(pnr);
+            }
+            else continue;
+            journalRecords++;
+        }
+
+        size_t size=f.size;
+        f.close();
+        if (good<size) truncateFile("bookings.journal",good);
+    }
+
+    // full snapshot, only written by compaction. Rejected rows go out first,
+    // so a crash in between can only duplicate them in bookings.rejects.
+    bool saveBookings(const BookingImage &image) {
+        if (!saveRejects(rejected)) return false;
+        rejected.clear();
+        return replaceFile("bookings.csv",image.csv());
+    }
+
+    static bool saveRejects(const vector<string> &rows) {
+        if (rows.empty()) return true;
+        string data;
+        for (int i=0;i<rows.size();i++) { data+=rows[i]; data+='\n'; }
+        AppendFile f;
+        return f.open("bookings.rejects",false) && f.append(data) && f.sync();
+    }
+
+    // queued, not yet on disk: see saveState()
+    bool appendJournal(string record, const string &pnr) {
+        unsigned long long seq;
+        if (!writer.push(journalLine(record),seq)) return false;
+        journalSeq[pnr]=seq;
+        journalRecords++;
+        if (journalRecords>=compactEvery) foldJournal();
         return true;
     }
 
-    bool saveBookings() {
-        ofstream f("bookings.csv");
-        f<<"pnr,name,age,trainNo,trainName,classType,seatNo,fare,departure\n";
+    // compact() without the frame stall: the store is copied out here and
+    // the writer formats and saves it after the records queued so far. Past
+    // journeys wait for the next compact(). A failed save leaves the journal
+    // whole, and the next fold (compactEvery records on) covers it.
+    void foldJournal() {
+        if (writer.folding()) return;
+        vector<string> rows;
+        rows.swap(rejected);
+        BookingImage image=bookingImage();
+        string seq=to_string(pnrGen.next.load())+"\n";
+        writer.fold([rows=move(rows),image=move(image),seq]() {
+            return saveRejects(rows) && replaceFile("bookings.csv",image.csv())
+                && image.snapshot().save("bookings.bin","bookings.csv",sizeof(BookingRecord))
+                && replaceFile("pnr.gui.seq",seq);
+        });
+        journalRecords=0;
+    }
+
+    enum SaveState { SAVED, SAVING, NOT_SAVED };
+
+    // whether a booking's latest add/cancel has reached the disk
+    SaveState saveState(const string &pnr) {
+        auto it=journalSeq.find(pnr);
+        if (it==journalSeq.end() || writer.isCommitted(it->second)) return SAVED;
+        return writer.failed ? NOT_SAVED : SAVING;
+    }
 
-        for (int i=0;i<bookings.size();i++) {
-            Booking &b = bookings[i];
-            f<<b.pnr<<","<<b.name<<","<<b.age<<","<<b.trainNo<<","
-             <<b.trainName<<","<<b.classType<<","<<b.seatNo<<","
-             <<b.fare<<","<<b.departure<<"\n";
+    // past journeys -> bookings.archive (appended, same csv lines), out of
+    // the store and seat maps. Archive is written first: a crash can only
+    // duplicate archived lines. Returns how many moved, -1 on error.
+    int archiveBefore(int day) {
+        vector<int> old;
+        for (int i=0;i<bookings.slots();i++)
+            if (bookings.live[i] && bookings.date[i]>=0 && bookings.date[i]<day) old.push_back(i);
+        if (old.empty()) return 0;
+
+        ofstream f("bookings.archive",ios::app);
+        if (!f.is_open()) return -1;
+        for (int i=0;i<old.size();i++) f<<bookingLine(bookings.get(old[i]))<<"\n";
+        f.close();
+        if (f.fail()) return -1;
+
+        for (int i=0;i<old.size();i++) bookings.remove(old[i]);
+        for (auto it=seatMaps.begin();it!=seatMaps.end();) {
+            int d=(int)(it->first>>32);
+            if (d>=0 && d<day) it=seatMaps.erase(it); else it++;
         }
+        return old.size();
+    }
+
+    bool compact() {
+        writer.drain();
+        if (archiveBefore(today())<0) return false;
+        BookingImage image=bookingImage();
+        if (!saveBookings(image)) return false;
+        if (!saveBookingSnapshot(image)) return false;
+        if (!savePnrSequence()) return false;
+        if (!writer.markSaved()) return false;
+        journalRecords=0;
         return true;
     }
 
-    vector<Train> searchByName(string key) {
+    // saved on compaction since cancelled pnrs drop out of the csv then;
+    // later ones are still in the journal and observed on replay. pnr.seq
+    // is bookingd's.
+    void loadPnrSequence() {
+        pnrGen.next=PnrGenerator::LOW;
+        ifstream f("pnr.gui.seq");
+        unsigned long long n;
+        if (f>>n) pnrGen.skipTo(n);
+    }
+
+    bool savePnrSequence() {
+        return replaceFile("pnr.gui.seq",to_string(pnrGen.next.load())+"\n");
+    }
+
+    // name or station, via the trigram index (fast enough per keystroke)
+    vector<Train> search(string key) {
         vector<Train> out;
-        for (int i=0;i<trains.size();i++)
-            if (trains[i].trainName.find(key)!=string::npos)
-                out.push_back(trains[i]);
+        vector<int> hits=grams.find(key);
+        for (int i=0;i<hits.size();i++) out.push_back(trains[hits[i]]);
+        return out;
+    }
+
+    // direct trains from -> to (exact station names), by departure
+    vector<Train> trainsBetween(string from, string to) {
+        vector<Train> out;
+        int a=pool.find(from), b=pool.find(to);
+        if (a<0 || b<0) return out;
+        auto it=routes.find(routeKey(a,b));
+        if (it==routes.end()) return out;
+        for (int i=0;i<it->second.size();i++) out.push_back(trains[it->second[i]]);
+        return out;
+    }
+
+    // trains calling at a and later at b (exact names), boarding at the
+    // first call at a, by departure from a
+    vector<Leg> trainsServing(string a, string b) {
+        vector<Leg> out;
+        int from=pool.find(a), to=pool.find(b);
+        if (from<0 || to<0 || from+1>=callStart.size() || to+1>=callStart.size()) return out;
+
+        // both lists are sorted by train: merge them
+        int i=callStart[from], iEnd=callStart[from+1];
+        int j=callStart[to], jEnd=callStart[to+1];
+        while (i<iEnd && j<jEnd) {
+            int ti=stationCalls[i].first, tj=stationCalls[j].first;
+            if (ti<tj) i++;
+            else if (tj<ti) j++;
+            else {
+                Leg leg;
+                leg.train=ti; leg.board=stationCalls[i].second; leg.alight=-1;
+                for (;j<jEnd && stationCalls[j].first==ti;j++)
+                    if (leg.alight<0 && stationCalls[j].second>leg.board) leg.alight=stationCalls[j].second;
+                while (i<iEnd && stationCalls[i].first==ti) i++;
+                if (leg.alight>=0) out.push_back(leg);
+            }
+        }
+        stable_sort(out.begin(),out.end(),[this](const Leg &x, const Leg &y){
+            return stopOf(x.train,x.board).dep<stopOf(y.train,y.board).dep;
+        });
+        return out;
+    }
+
+    // origin departure within [from,to] minutes, by departure; from>to wraps midnight
+    vector<Train> trainsLeaving(int from, int to) {
+        vector<Train> out;
+        if (from<0 || to<0) return out;
+        if (from<=to) appendLeaving(from,to,out);
+        else { appendLeaving(from,24*60-1,out); appendLeaving(0,to,out); }
         return out;
     }
 
+    void appendLeaving(int from, int to, vector<Train> &out) {
+        auto first=lower_bound(departures.begin(),departures.end(),from,[this](int i, int t){ return trains[i].dep<t; });
+        auto last=upper_bound(first,departures.end(),to,[this](int t, int i){ return t<trains[i].dep; });
+        for (;first!=last;first++) out.push_back(trains[*first]);
+    }
+
     const Train* findTrain(string no) {
-        for (int i=0;i<trains.size();i++)
-            if (trains[i].trainNo==no) return &trains[i];
-        return NULL;
+        return findById(pool.find(no));
+    }
+
+    // by trainNo pool id
+    const Train* findById(int trainNo) {
+        if (trainNo<0 || trainNo>=trainIndex.size() || trainIndex[trainNo]<0) return NULL;
+        return &trains[trainIndex[trainNo]];
     }
 
+    const Train* trainOf(const Booking &b) { return findById(b.trainNo); }
+
+    const char *str(int id) { return pool.str(id).c_str(); }
+
     vector<Booking> findBookings(string pnr) {
         vector<Booking> out;
-        for (int i=0;i<bookings.size();i++)
-            if (bookings[i].pnr==pnr) out.push_back(bookings[i]);
+        pair<unordered_multimap<string,int>::iterator,
+             unordered_multimap<string,int>::iterator> r=bookings.pnrIndex.equal_range(pnr);
+        for (unordered_multimap<string,int>::iterator it=r.first;it!=r.second;it++)
+            out.push_back(bookings.get(it->second));
         return out;
     }
 
-    int booked(string trainNo, string cls) {
-        int c=0;
-        for (int i=0;i<bookings.size();i++)
-            if (bookings[i].trainNo==trainNo && bookings[i].classType==cls)
-                c++;
-        return c;
+    // column scans over the booking store
+    long long totalRevenue() {
+        long long sum=0;
+        for (int i=0;i<bookings.slots();i++)
+            if (bookings.live[i]) sum+=bookings.fare[i];
+        return sum;
+    }
+
+    long long trainRevenue(int trainNo) {
+        long long sum=0;
+        for (int i=0;i<bookings.slots();i++)
+            if (bookings.live[i] && bookings.trainNo[i]==trainNo) sum+=bookings.fare[i];
+        return sum;
+    }
+
+    vector<int> occupancyByClass() {
+        vector<int> count(CLASS_COUNT,0);
+        for (int i=0;i<bookings.slots();i++)
+            if (bookings.live[i]) count[bookings.classType[i]]++;
+        return count;
+    }
+
+    // created on first use, all classes sized from seatCapacity, one
+    // segment per pair of consecutive stops
+    static unsigned long long partitionKey(int date, int trainNo) {
+        return ((unsigned long long)(unsigned int)date<<32)|(unsigned int)trainNo;
+    }
+
+    SeatMap &seatMap(int date, int trainNo, TravelClass cls) {
+        unordered_map<unsigned long long,vector<SeatMap> >::iterator it=seatMaps.find(partitionKey(date,trainNo));
+        if (it!=seatMaps.end()) return it->second[cls];
+
+        const Train *t=findById(trainNo);
+        int segs=t ? stopCount(t-&trains[0])-1 : 1;
+        vector<SeatMap> &maps=seatMaps[partitionKey(date,trainNo)];
+        maps.resize(CLASS_COUNT);
+        for (int c=0;c<CLASS_COUNT;c++) maps[c].resize(seatCapacity[c],segs);
+        return maps[cls];
+    }
+
+    // segments [l,r) from station `from` to `to` (-1 = origin/terminus);
+    // false if the train doesn't call there in that order. A train no
+    // longer in the timetable counts as one segment.
+    bool segmentsOf(int trainNo, int from, int to, int &l, int &r) {
+        const Train *t=findById(trainNo);
+        if (!t) { l=0; r=1; return true; }
+        int train=t-&trains[0], n=stopCount(train);
+        l=0; r=max(n-1,1);
+        if (from>=0) {
+            for (l=0;l<n-1 && stopOf(train,l).station!=from;l++) {}
+            if (l>=n-1) return false;
+        }
+        if (to>=0) {
+            for (r=l+1;r<n && stopOf(train,r).station!=to;r++) {}
+            if (r>=n) return false;
+        }
+        return true;
+    }
+
+    // read-only lookup: looking at a date doesn't allocate its partition
+    const SeatMap *findSeatMap(int date, int trainNo, TravelClass cls) const {
+        auto it=seatMaps.find(partitionKey(date,trainNo));
+        return it==seatMaps.end() ? NULL : &it->second[cls];
+    }
+
+    // reservations in the class that day, whatever their legs
+    int booked(int date, int trainNo, TravelClass cls) {
+        const SeatMap *m=findSeatMap(date,trainNo,cls);
+        return m ? m->used : 0;
+    }
+
+    // seats free for the whole of from -> to that day
+    int freeSeats(int date, int trainNo, TravelClass cls, int from, int to) {
+        int l, r;
+        if (!segmentsOf(trainNo,from,to,l,r)) return 0;
+        const SeatMap *m=findSeatMap(date,trainNo,cls);
+        return m ? m->freeCount(l,r) : seatCapacity[cls];
+    }
+
+    // -1 when nothing is free for that leg and day
+    int nextSeat(int date, int trainNo, TravelClass cls, int from, int to) {
+        int l, r;
+        if (!segmentsOf(trainNo,from,to,l,r)) return -1;
+        return seatMap(date,trainNo,cls).firstFree(l,r);
     }
 
-    int nextSeat(string trainNo, string cls) {
-        return booked(trainNo,cls)+1;
+    // today .. today+bookingHorizon
+    bool bookableDate(int date) {
+        int now=today();
+        return date>=now && date<=now+bookingHorizon;
+    }
+
+    // take b.seatNo for b's leg, or the best free seat if someone got it first
+    bool claimSeat(Booking &b) {
+        int l, r;
+        if (!segmentsOf(b.trainNo,b.from,b.to,l,r)) return false;
+        SeatMap &m=seatMap(b.date,b.trainNo,b.classType);
+        if (m.take(b.seatNo,l,r)) return true;
+        int seat=m.firstFree(l,r);
+        if (seat<0) return false;
+        m.take(seat,l,r);
+        b.seatNo=seat;
+        return true;
+    }
+
+    // after a timetable reload the stop lists may differ: re-take all seats
+    void rebuildSeatMaps() {
+        seatMaps.clear();
+        for (int i=0;i<bookings.slots();i++) {
+            if (!bookings.live[i]) continue;
+            Booking b=bookings.get(i);
+            if (!claimSeat(b)) b.seatNo=0;
+            bookings.seatNo[i]=b.seatNo;
+        }
     }
 
     string makePNR() {
-        return to_string(rand()%900000+100000);
+        return pnrGen.make();
+    }
+
+    // b.seatNo is updated to the seat actually claimed; false = class full
+    bool addBooking(Booking &b) {
+        if (writer.full()) return false;
+        if (!claimSeat(b)) return false;
+        storeBooking(b);
+        return appendJournal("A,"+bookingLine(b),b.pnr);
+    }
+
+    // clashing seats from older files move to a free seat, overflow gets 0
+    void loadBooking(Booking &b) {
+        if (!claimSeat(b)) b.seatNo=0;
+        storeBooking(b);
     }
 
-    bool addBooking(Booking b) {
-        bookings.push_back(b);
-        return saveBookings();
+    void storeBooking(const Booking &b) {
+        bookings.insert(b);
+        pnrGen.observe(b.pnr);
+    }
+
+    bool removeBooking(string pnr) {
+        int slot=bookings.find(pnr);
+        if (slot<0) return false;
+        int l, r;
+        if (segmentsOf(bookings.trainNo[slot],bookings.from[slot],bookings.to[slot],l,r))
+            seatMap(bookings.date[slot],bookings.trainNo[slot],(TravelClass)bookings.classType[slot]).release(bookings.seatNo[slot],l,r);
+        bookings.remove(slot);
+        return true;
     }
 
     bool cancel(string pnr) {
-        for (int i=0;i<bookings.size();i++) {
-            if (bookings[i].pnr==pnr) {
-                bookings.erase(bookings.begin()+i);
-                return saveBookings();
-            }
+        if (writer.full()) return false;
+        if (!removeBooking(pnr)) return false;
+        return appendJournal("C,"+pnr,pnr);
+    }
+};
+
+// ---------------- BOOKING SERVICE CLIENT ----------------
+#ifdef _WIN32
+typedef SOCKET socket_t;
+static const socket_t BAD_SOCKET=INVALID_SOCKET;
+static void closeSocket(socket_t s) { closesocket(s); }
+#else
+typedef int socket_t;
+static const socket_t BAD_SOCKET=-1;
+static void closeSocket(socket_t s) { close(s); }
+#endif
+
+// talks to bookingd over its socket (protocol above class BookingService
+// in datamanager.cpp), so the GUI shares bookingd's store instead of
+// keeping its own. Calls block until the reply is in; bookingd sends that
+// once a booking or cancel is on disk, a few ms.
+struct ServiceClient {
+    static const int TIMEOUT_MS=5000;
+
+    string path;
+    socket_t fd=BAD_SOCKET;
+    string in;      // received past the last reply
+    string error;   // why the last call failed, shown as is
+
+    ServiceClient(const string &p) : path(p) {}
+    ServiceClient(const ServiceClient&)=delete;
+    ServiceClient &operator=(const ServiceClient&)=delete;
+    ~ServiceClient() { close(); }
+
+    bool connected() const { return fd!=BAD_SOCKET; }
+
+    bool connect() {
+        close();
+        sockaddr_un addr;
+        memset(&addr,0,sizeof(addr));
+        addr.sun_family=AF_UNIX;
+        if (path.size()>=sizeof(addr.sun_path)) return false;
+        strcpy(addr.sun_path,path.c_str());
+
+        fd=socket(AF_UNIX,SOCK_STREAM,0);
+        if (fd==BAD_SOCKET) return false;
+        if (::connect(fd,(sockaddr*)&addr,sizeof(addr))!=0) { close(); return false; }
+
+        // a stuck service fails the call rather than freezing the window
+#ifdef _WIN32
+        DWORD ms=TIMEOUT_MS;
+        setsockopt(fd,SOL_SOCKET,SO_RCVTIMEO,(const char*)&ms,sizeof(ms));
+        setsockopt(fd,SOL_SOCKET,SO_SNDTIMEO,(const char*)&ms,sizeof(ms));
+#else
+        timeval tv;
+        tv.tv_sec=TIMEOUT_MS/1000; tv.tv_usec=(TIMEOUT_MS%1000)*1000;
+        setsockopt(fd,SOL_SOCKET,SO_RCVTIMEO,&tv,sizeof(tv));
+        setsockopt(fd,SOL_SOCKET,SO_SNDTIMEO,&tv,sizeof(tv));
+#endif
+        return true;
+    }
+
+    void close() {
+        if (fd!=BAD_SOCKET) closeSocket(fd);
+        fd=BAD_SOCKET;
+        in.clear();
+    }
+
+    // one request out, the reply's result rows back. false with `error`
+    // set on "ERR ..." or a lost connection; the next call reconnects, so
+    // a bookingd started later is picked up
+    bool call(const string &request, vector<string> &rows) {
+        rows.clear();
+        if (!connected() && !connect()) { error="bookingd is not running"; return false; }
+
+        string out=request+"\n";
+        for (size_t done=0;done<out.size();) {
+            int n=send(fd,out.data()+done,(int)(out.size()-done),0);
+            if (n<=0) return lost();
+            done+=n;
+        }
+
+        string line;
+        if (!readLine(line)) return lost();
+        if (line.compare(0,4,"ERR ")==0) { error=line.substr(4); return false; }
+        if (line.compare(0,3,"OK ")!=0) return lost();
+        int n=toInt(string_view(line).substr(3));
+        for (int i=0;i<n;i++) {
+            if (!readLine(line)) return lost();
+            rows.push_back(line);
         }
+        return true;
+    }
+
+    bool lost() {
+        close();
+        error="lost the connection to bookingd";
         return false;
     }
+
+    bool readLine(string &line) {
+        size_t eol;
+        while ((eol=in.find('\n'))==string::npos) {
+            char buf[4096];
+            int n=recv(fd,buf,sizeof(buf),0);
+            if (n<=0) return false;
+            in.append(buf,n);
+        }
+        line=in.substr(0,eol);
+        in.erase(0,eol+1);
+        return true;
+    }
+
+    // free seats per class from `from` to `to` that day, -1 for classes
+    // the train doesn't have
+    bool freeSeats(Database &db, int trainNo, int date, int from, int to, int out[CLASS_COUNT]) {
+        vector<string> rows;
+        string req="A\t"+db.pool.str(trainNo)+"\t"+formatDate(date)+"\t"+db.stationName(from)+"\t"+db.stationName(to);
+        if (!call(req,rows)) return false;
+
+        for (int c=0;c<CLASS_COUNT;c++) out[c]=-1;
+        vector<string_view> p;
+        for (int i=0;i<rows.size();i++) {
+            CsvReader csv(rows[i].data(),rows[i].size());
+            if (!csv.next(p,'\t') || p.size()<2) continue;
+            TravelClass c=classFromCode(p[0]);
+            if (c!=CLASS_COUNT) out[c]=toInt(p[1]);
+        }
+        return true;
+    }
+
+    // bookingd picks the PNR and seat: b.pnr, b.seatNo and b.fare come back
+    bool book(Database &db, Booking &b) {
+        vector<string> rows;
+        string req="B\t"+b.name+"\t"+to_string(b.age)+"\t"+db.pool.str(b.trainNo)+"\t"+CLASS_CODES[b.classType]+"\t"+
+                   formatDate(b.date)+"\t"+db.stationName(b.from)+"\t"+db.stationName(b.to);
+        if (!call(req,rows)) return false;
+
+        vector<string_view> p;
+        CsvReader csv(rows.empty() ? "" : rows[0].data(),rows.empty() ? 0 : rows[0].size());
+        if (!csv.next(p,'\t') || p.size()<3) { error="unexpected reply from bookingd"; return false; }
+        b.pnr=p[0]; b.seatNo=toInt(p[1]); b.fare=toInt(p[2]);
+        return true;
+    }
+
+    bool findBookings(Database &db, const string &pnr, vector<Booking> &out) {
+        out.clear();
+        vector<string> rows;
+        if (!call("P\t"+pnr,rows)) return false;
+
+        vector<string_view> p;
+        for (int i=0;i<rows.size();i++) {
+            CsvReader csv(rows[i].data(),rows[i].size());
+            Booking b;
+            if (csv.next(p,',') && db.parseBooking(p,0,b)) out.push_back(b);
+        }
+        return true;
+    }
+
+    bool cancel(const string &pnr) {
+        vector<string> rows;
+        return call("C\t"+pnr,rows);
+    }
 };
 
 // ---------------- UI STATE ----------------
 int g_page = 1;
 
+// bookings go through bookingd instead of db's own store (see main)
+bool useService=false;
+ServiceClient service("booking.sock");
+
 char nameBuf[256]="";
 char searchBuf[256]="";
+char fromBuf[256]="";
+char toBuf[256]="";
+char leaveFromBuf[16]="06:00";
+char leaveToBuf[16]="10:00";
+char dateBuf[16]="";    // journey date for Availability and Book, set to today at start
 char trainNoBuf[256]="";
 char ageBuf[16]="";
 char pnrBuf[256]="";
 char pnrCancelBuf[256]="";
 
 vector<string> trainList;
-vector<string> classList;
+vector<TravelClass> classList;
 
 int selectedTrain = -1;
 int selectedClass = -1;
+string stopItems;       // the selected train's stations, '\0'-separated for ImGui::Combo
+int stopTotal = 0;
+int boardStop = 0;
+int alightStop = 0;
 
 Booking pending;
 bool hasPending=false;
+string bookMsg;
+string cancelMsg;
+
+// frame time up to the swap (vsync waits not counted), shown in the sidebar
+const double FRAME_BUDGET_MS=16.0;
+double frameMs=0, worstFrameMs=0;
+int slowFrames=0;
 
 // ---------------- Build class list ----------------
 void updateClassList(int idx, Database &db) {
@@ -208,20 +2127,64 @@ void updateClassList(int idx, Database &db) {
     selectedClass=-1;
     if (idx<0) return;
 
-    for (set<string>::iterator it=db.trains[idx].classes.begin();
-         it!=db.trains[idx].classes.end(); it++)
-        classList.push_back(*it);
+    for (int c=0;c<CLASS_COUNT;c++)
+        if (db.trains[idx].hasClass((TravelClass)c)) classList.push_back((TravelClass)c);
+}
+
+// ---------------- Build stop list ----------------
+void updateStopList(int idx, Database &db) {
+    stopItems.clear();
+    stopTotal=0; boardStop=0; alightStop=0;
+    if (idx<0) return;
+
+    stopTotal=db.stopCount(idx);
+    for (int k=0;k<stopTotal;k++) {
+        stopItems+=db.pool.str(db.stopOf(idx,k).station);
+        stopItems.push_back('\0');
+    }
+    alightStop=stopTotal-1;
 }
 
 // ---------------- Build train list ----------------
 void buildTrainList(Database &db) {
     trainList.clear();
     for (int i=0;i<db.trains.size();i++)
-        trainList.push_back(db.trains[i].trainNo+" - "+db.trains[i].trainName);
+        trainList.push_back(db.pool.str(db.trains[i].trainNo)+" - "+db.pool.str(db.trains[i].trainName));
+}
+
+// ---------------- Booking files ----------------
+// bookingd moves bookings.csv into its own bookings.<k>.csv shards on first
+// start and only uses those after that, so bookings.csv is a stale copy and
+// the GUI books through bookingd. Same test as bookingd's shardsOnDisk():
+// the marker, or for older conversions every shard's csv.
+bool managedByService() {
+    long long size, mtime;
+    if (fileStamp(SHARD_MARKER,size,mtime)) return true;
+    for (int k=0;k<SHARD_COUNT;k++)
+        if (!fileStamp("bookings."+to_string(k)+".csv",size,mtime)) return false;
+    return true;
 }
 
 // ---------------- MAIN ----------------
 int main() {
+#ifdef _WIN32
+    WSADATA wsa;
+    WSAStartup(MAKEWORD(2,2),&wsa);
+#else
+    signal(SIGPIPE,SIG_IGN);    // a bookingd that went away fails the send instead
+#endif
+
+    // Book through bookingd when it runs here, so both share its store.
+    // Once it owns the folder, always: a request while it is down just
+    // says so, and the next one tries again.
+    useService=service.connect() || managedByService();
+
+    DirectoryLock lock;
+    if (!useService && !lock.acquire("bookings.lock")) {
+        SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR,"Train Ticket System",
+            "bookingd or another copy of this program is already using the bookings in this folder.",NULL);
+        return 1;
+    }
 
     SDL_Init(SDL_INIT_VIDEO);
 
@@ -241,11 +2204,19 @@ int main() {
 
     Database db;
     db.loadTrains();
-    db.loadBookings();
+    if(!useService){
+        db.loadBookings();
+        // records left by a session that didn't exit cleanly: fold them now
+        // rather than replay them on every start
+        if(db.journalRecords>0) db.compact();
+    }
     buildTrainList(db);
+    snprintf(dateBuf,sizeof(dateBuf),"%s",formatDate(today()).c_str());
 
     bool run=true;
+    double tickMs=1000.0/SDL_GetPerformanceFrequency();
     while(run){
+        Uint64 frameStart=SDL_GetPerformanceCounter();
         SDL_Event e;
         while(SDL_PollEvent(&e)){
             ImGui_ImplSDL2_ProcessEvent(&e);
@@ -267,6 +2238,18 @@ int main() {
         if(ImGui::Button("Summary",ImVec2(180,30))) g_page=5;
         if(ImGui::Button("View",ImVec2(180,30))) g_page=6;
         if(ImGui::Button("Cancel",ImVec2(180,30))) g_page=7;
+        if(ImGui::Button("Route",ImVec2(180,30))) g_page=8;
+        if(ImGui::Button("Departures",ImVec2(180,30))) g_page=9;
+
+        ImGui::Separator();
+        if(useService) ImGui::Text(service.connected() ? "bookingd: connected" : "bookingd: not running");
+        else{
+            ImGui::Text("Unsaved: %llu",db.writer.backlog());
+            if(db.writer.failed) ImGui::Text("Journal write failed!");
+        }
+        ImGui::Text("Frame: %.1f ms",frameMs);
+        ImGui::Text("Worst: %.1f ms",worstFrameMs);
+        ImGui::Text("Over %.0f ms: %d",FRAME_BUDGET_MS,slowFrames);
         ImGui::EndChild();
 
         ImGui::SameLine();
@@ -280,27 +2263,36 @@ int main() {
             if(ImGui::Button("Reload")) {
                 db.loadTrains();
                 buildTrainList(db);
+                // positions and stop lists may have changed
+                selectedTrain=-1;
+                updateClassList(-1,db);
+                updateStopList(-1,db);
             }
 
             for(int i=0;i<db.trains.size();i++){
                 Train&t=db.trains[i];
-                ImGui::Text("%s - %s",t.trainNo.c_str(),t.trainName.c_str());
+                ImGui::Text("%s - %s",db.str(t.trainNo),db.str(t.trainName));
                 ImGui::Separator();
             }
         }
 
         // 2. Search
         if(g_page==2){
-            ImGui::InputText("Train Name",searchBuf,256);
             static vector<Train> result;
+            static int resultVersion = -1;
 
-            if(ImGui::Button("Search"))
-                result = db.searchByName(searchBuf);
+            // re-query on every edit, and after every Reload
+            if(ImGui::InputText("Train / Station",searchBuf,256) || resultVersion!=db.timetableVersion){
+                result = db.search(searchBuf);
+                resultVersion = db.timetableVersion;
+            }
 
             for(int i=0;i<result.size();i++){
-                ImGui::Text("%s - %s",
-                    result[i].trainNo.c_str(),
-                    result[i].trainName.c_str());
+                ImGui::Text("%s - %s (%s - %s)",
+                    db.str(result[i].trainNo),
+                    db.str(result[i].trainName),
+                    db.str(result[i].from),
+                    db.str(result[i].to));
                 ImGui::Separator();
             }
         }
@@ -308,19 +2300,42 @@ int main() {
         // 3. Availability
         if(g_page==3){
             ImGui::InputText("Train No",trainNoBuf,256);
+            ImGui::InputText("Date (YYYY-MM-DD)",dateBuf,16);
             static vector<Train> result;
+            static int resultVersion=0;
+            // bookingd's answer, asked on Check and when the date changes
+            static int serviceFree[CLASS_COUNT];
+            static int serviceDay=-1;
+            static bool serviceOk=false;
             if(ImGui::Button("Check")){
                 result.clear();
                 const Train*t=db.findTrain(trainNoBuf);
                 if(t!=NULL) result.push_back(*t);
+                resultVersion=db.timetableVersion;
+                serviceDay=-1;
             }
+            if(resultVersion!=db.timetableVersion) result.clear();
 
             if(!result.empty()){
                 Train&t=result[0];
-                for(set<string>::iterator it=t.classes.begin();it!=t.classes.end();it++){
-                    string c=*it;
-                    int a=db.seatCapacity[c]-db.booked(t.trainNo,c);
-                    ImGui::Text("%s : %d available",c.c_str(),a);
+                int day=parseDate(dateBuf);
+                if(day<0) ImGui::Text("Enter the date as YYYY-MM-DD");
+                else if(useService){
+                    if(day!=serviceDay){
+                        serviceDay=day;
+                        serviceOk=service.freeSeats(db,t.trainNo,day,-1,-1,serviceFree);
+                    }
+                    if(!serviceOk) ImGui::Text("%s",service.error.c_str());
+                    else for(int c=0;c<CLASS_COUNT;c++)
+                        if(serviceFree[c]>=0) ImGui::Text("%s : %d available end to end",CLASS_CODES[c],serviceFree[c]);
+                }
+                else{
+                    for(int c=0;c<CLASS_COUNT;c++){
+                        if(!t.hasClass((TravelClass)c)) continue;
+                        int a=db.freeSeats(day,t.trainNo,(TravelClass)c,-1,-1);
+                        ImGui::Text("%s : %d available end to end",CLASS_CODES[c],a);
+                    }
+                    ImGui::Text("Booked revenue: %lld",db.trainRevenue(t.trainNo));
                 }
             }
         }
@@ -336,35 +2351,70 @@ int main() {
                 if(ImGui::Selectable(trainList[i].c_str(),sel)){
                     selectedTrain=i;
                     updateClassList(i,db);
+                    updateStopList(i,db);
                 }
             }
 
             ImGui::Text("Select Class:");
             for(int i=0;i<classList.size();i++){
                 bool sel=(selectedClass==i);
-                if(ImGui::RadioButton(classList[i].c_str(),sel))
+                if(ImGui::RadioButton(CLASS_CODES[classList[i]],sel))
                     selectedClass=i;
             }
 
+            if(selectedTrain>=0){
+                ImGui::Combo("Board at",&boardStop,stopItems.c_str());
+                ImGui::Combo("Alight at",&alightStop,stopItems.c_str());
+            }
+
+            ImGui::InputText("Date (YYYY-MM-DD)",dateBuf,16);
+
             if(ImGui::Button("Proceed")){
-                if(selectedTrain>=0 && selectedClass>=0){
+                bookMsg="";
+                int day=parseDate(dateBuf);
+                // a comma would split the CSV row, same rule as bookingd
+                if(nameBuf[0]==0 || strchr(nameBuf,','))
+                    bookMsg="Enter a name without commas";
+                else if(atoi(ageBuf)<=0)
+                    bookMsg="Enter an age above 0";
+                else if(!db.bookableDate(day))
+                    bookMsg="Pick a date from today to "+formatDate(today()+db.bookingHorizon);
+                else if(selectedTrain>=0 && selectedClass>=0){
                     Train&t=db.trains[selectedTrain];
-                    string cls = classList[selectedClass];
-
-                    pending.pnr=db.makePNR();
-                    pending.name=nameBuf;
-                    pending.age=atoi(ageBuf);
-                    pending.trainNo=t.trainNo;
-                    pending.trainName=t.trainName;
-                    pending.classType=cls;
-                    pending.seatNo=db.nextSeat(t.trainNo,cls);
-                    pending.fare=db.fares[cls];
-                    pending.departure=t.dep;
-
-                    hasPending=true;
-                    g_page=5;
+                    TravelClass cls = classList[selectedClass];
+                    // whole run stays -1/-1, which survives stop list edits
+                    int from = boardStop>0 ? db.stopOf(selectedTrain,boardStop).station : -1;
+                    int to = alightStop<stopTotal-1 ? db.stopOf(selectedTrain,alightStop).station : -1;
+                    int seat=-1;
+                    bool asked=true;
+                    if(alightStop>boardStop && !useService) seat=db.nextSeat(day,t.trainNo,cls,from,to);
+                    else if(alightStop>boardStop){
+                        // bookingd picks PNR and seat on Confirm; only check one is free
+                        int free[CLASS_COUNT];
+                        asked=service.freeSeats(db,t.trainNo,day,from,to,free);
+                        if(asked && free[cls]>0) seat=0;
+                    }
+                    if(alightStop<=boardStop) bookMsg="Alight at a stop after boarding";
+                    else if(!asked) bookMsg=service.error;
+                    else if(seat<0) bookMsg=string("No seats left in ")+CLASS_CODES[cls];
+                    else{
+                        pending.pnr=useService ? "" : db.makePNR();
+                        pending.name=nameBuf;
+                        pending.age=atoi(ageBuf);
+                        pending.trainNo=t.trainNo;
+                        pending.classType=cls;
+                        pending.seatNo=seat;
+                        pending.from=from;
+                        pending.to=to;
+                        pending.date=day;
+                        pending.fare=db.fares[cls];
+
+                        hasPending=true;
+                        g_page=5;
+                    }
                 }
             }
+            if(bookMsg!="") ImGui::Text("%s",bookMsg.c_str());
         }
 
         // 5. Summary
@@ -372,14 +2422,29 @@ int main() {
             if(!hasPending) ImGui::Text("No pending booking.");
             else{
                 ImGui::Text("Passenger: %s",pending.name.c_str());
-                ImGui::Text("Train: %s", pending.trainName.c_str());
-                ImGui::Text("Class: %s", pending.classType.c_str());
+                const Train *pt=db.trainOf(pending);
+                ImGui::Text("Train: %s", pt ? db.str(pt->trainName) : "");
+                ImGui::Text("Class: %s", CLASS_CODES[pending.classType]);
+                ImGui::Text("Date: %s", formatDate(pending.date).c_str());
+                ImGui::Text("From: %s", pending.from>=0 ? db.str(pending.from) : (pt ? db.str(pt->from) : ""));
+                ImGui::Text("To: %s", pending.to>=0 ? db.str(pending.to) : (pt ? db.str(pt->to) : ""));
                 ImGui::Text("Fare: %d", pending.fare);
 
                 if(ImGui::Button("Confirm")){
-                    db.addBooking(pending);
-                    g_page=6;
+                    bookMsg="";
+                    if(useService){
+                        if(!service.book(db,pending)) bookMsg="Booking failed: "+service.error;
+                    }
+                    else if(db.writer.full()) bookMsg="Still saving earlier bookings, try again";
+                    else if(!db.addBooking(pending)) bookMsg="Booking failed (class full or disk error)";
+
+                    if(bookMsg==""){
+                        snprintf(pnrBuf,sizeof(pnrBuf),"%s",pending.pnr.c_str());
+                        hasPending=false;
+                        g_page=6;
+                    }
                 }
+                if(bookMsg!="") ImGui::Text("%s",bookMsg.c_str());
             }
         }
 
@@ -387,13 +2452,22 @@ int main() {
         if(g_page==6){
             ImGui::InputText("PNR",pnrBuf,256);
             static vector<Booking> res;
+            static string viewMsg;
 
-            if(ImGui::Button("Search"))
-                res=db.findBookings(pnrBuf);
+            if(ImGui::Button("Search")){
+                viewMsg="";
+                if(!useService) res=db.findBookings(pnrBuf);
+                else if(!service.findBookings(db,pnrBuf,res)) viewMsg=service.error;
+            }
+            if(viewMsg!="") ImGui::Text("%s",viewMsg.c_str());
 
             for(int i=0;i<res.size();i++){
                 ImGui::Text("Passenger: %s",res[i].name.c_str());
                 ImGui::Text("Seat: %d",res[i].seatNo);
+                if(res[i].date>=0) ImGui::Text("Date: %s",formatDate(res[i].date).c_str());
+                // bookingd only answers for what is on disk
+                Database::SaveState s=useService ? Database::SAVED : db.saveState(res[i].pnr);
+                ImGui::Text("%s", s==Database::SAVED ? "Saved" : s==Database::SAVING ? "Saving..." : "Not saved (disk error)");
                 ImGui::Separator();
             }
         }
@@ -403,13 +2477,76 @@ int main() {
             ImGui::InputText("PNR",pnrCancelBuf,256);
             static vector<Booking> res;
 
-            if(ImGui::Button("Find"))
-                res=db.findBookings(pnrCancelBuf);
+            if(ImGui::Button("Find")){
+                cancelMsg="";
+                if(!useService) res=db.findBookings(pnrCancelBuf);
+                else if(!service.findBookings(db,pnrCancelBuf,res)) cancelMsg=service.error;
+            }
 
             for(int i=0;i<res.size();i++){
                 ImGui::Text("Passenger: %s",res[i].name.c_str());
-                if(ImGui::Button("Cancel"))
-                    db.cancel(res[i].pnr);
+                if(ImGui::Button("Cancel")){
+                    if(useService) cancelMsg=service.cancel(res[i].pnr) ? "Cancelled." : "Cancel failed: "+service.error;
+                    else if(db.writer.full()) cancelMsg="Still saving earlier bookings, try again";
+                    else cancelMsg=db.cancel(res[i].pnr) ? "Cancelled." : "Cancel failed (not found or disk error)";
+                }
+                ImGui::Separator();
+            }
+            if(cancelMsg!="") ImGui::Text("%s",cancelMsg.c_str());
+        }
+
+        // 8. Route
+        if(g_page==8){
+            ImGui::InputText("From",fromBuf,256);
+            ImGui::InputText("To",toBuf,256);
+            static vector<Leg> res;
+            static int resVersion=0;
+
+            // any train calling at From and later at To, not only end to end
+            if(ImGui::Button("Find")){
+                res=db.trainsServing(fromBuf,toBuf);
+                resVersion=db.timetableVersion;
+            }
+            if(resVersion!=db.timetableVersion) res.clear(); // train and stop positions stale after a Reload
+
+            if(res.empty()) ImGui::Text("No trains");
+            for(int i=0;i<res.size();i++){
+                const Train &t=db.trains[res[i].train];
+                ImGui::Text("%s - %s  dep %s  arr %s",
+                    db.str(t.trainNo),
+                    db.str(t.trainName),
+                    formatTime(db.stopOf(res[i].train,res[i].board).dep).c_str(),
+                    formatTime(db.stopOf(res[i].train,res[i].alight).arr).c_str());
+                ImGui::Separator();
+            }
+        }
+
+        // 9. Departures
+        if(g_page==9){
+            ImGui::InputText("Leaving after",leaveFromBuf,16);
+            ImGui::InputText("Leaving before",leaveToBuf,16);
+            static vector<Train> res;
+            static int resVersion=0;
+
+            if(ImGui::Button("Find")){
+                int a=parseTime(leaveFromBuf), b=parseTime(leaveToBuf);
+                res=db.trainsLeaving(a,b);
+                resVersion=db.timetableVersion;
+                if(a<0 || b<0) ImGui::OpenPopup("Bad time");
+            }
+            if(resVersion!=db.timetableVersion) res.clear();
+            if(ImGui::BeginPopup("Bad time")){
+                ImGui::Text("Times are HH:MM");
+                ImGui::EndPopup();
+            }
+
+            for(int i=0;i<res.size();i++){
+                ImGui::Text("%s  %s - %s (%s - %s)",
+                    formatTime(res[i].dep).c_str(),
+                    db.str(res[i].trainNo),
+                    db.str(res[i].trainName),
+                    db.str(res[i].from),
+                    db.str(res[i].to));
                 ImGui::Separator();
             }
         }
@@ -421,9 +2558,16 @@ int main() {
         ImGui::Render();
         glClear(GL_COLOR_BUFFER_BIT);
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+
+        frameMs=(SDL_GetPerformanceCounter()-frameStart)*tickMs;
+        if(frameMs>worstFrameMs) worstFrameMs=frameMs;
+        if(frameMs>FRAME_BUDGET_MS) slowFrames++;
         SDL_GL_SwapWindow(window);
     }
 
+    // fold the journal back into bookings.csv
+    if(!useService) db.compact();
+
     // Cleanup
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplSDL2_Shutdown();
@@ -431,5 +2575,8 @@ int main() {
     SDL_GL_DeleteContext(gl);
     SDL_DestroyWindow(window);
     SDL_Quit();
+#ifdef _WIN32
+    WSACleanup();
+#endif
     return 0;
 }
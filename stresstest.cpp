@@ -0,0 +1,282 @@
+// Concurrency stress test and contention benchmark for the Database in
+// datamanager.cpp. N threads book (plain and reserve-then-book), release
+// holds and cancel on the same trains and a few dates, so they keep
+// colliding on shards and seat maps. Afterwards no seat may be sold twice
+// on a (date, train, class), no PNR may appear twice, and reloading the
+// files must give back exactly the same bookings.
+//
+// Runs on stress.* files next to trains.csv and removes them again, so
+// real bookings are never touched.
+//
+//   stresstest                  1, 8 and 32 threads, 4000 operations each
+//   stresstest <threads> [ops]  one run
+//
+// Exits with 1 if any check fails.
+#define BOOKINGD_NO_MAIN
+#include "datamanager.cpp"
+
+static const char *PREFIX = "stress.";
+static const int DAYS = 3;      // few dates, so classes fill up and collide
+
+// -------------------- FILES --------------------
+// Everything the Database writes goes under PREFIX
+static void usePrefix(Database &db) {
+    db.trainSnapshot = PREFIX + db.trainSnapshot;
+    db.pnrFile = PREFIX + db.pnrFile;
+    db.bookingFile = PREFIX + db.bookingFile;
+    db.journalFile = PREFIX + db.journalFile;
+    db.bookingSnapshot = PREFIX + db.bookingSnapshot;
+    db.shardMarker = PREFIX + db.shardMarker;
+    db.archiveFile = PREFIX + db.archiveFile;
+    db.rejectFile = PREFIX + db.rejectFile;
+    for (int k = 0; k < SHARD_COUNT; k++) {
+        db.shards[k].bookingFile = PREFIX + db.shards[k].bookingFile;
+        db.shards[k].journalFile = PREFIX + db.shards[k].journalFile;
+        db.shards[k].bookingSnapshot = PREFIX + db.shards[k].bookingSnapshot;
+    }
+}
+
+static void removeFiles() {
+    Database db;
+    usePrefix(db);
+    remove(db.trainSnapshot.c_str());
+    remove(db.pnrFile.c_str());
+    remove(db.bookingFile.c_str());
+    remove(db.journalFile.c_str());
+    remove(db.bookingSnapshot.c_str());
+    remove(db.shardMarker.c_str());
+    remove(db.archiveFile.c_str());
+    remove(db.rejectFile.c_str());
+    for (int k = 0; k < SHARD_COUNT; k++) {
+        remove(db.shards[k].bookingFile.c_str());
+        remove(db.shards[k].journalFile.c_str());
+        remove(db.shards[k].bookingSnapshot.c_str());
+    }
+}
+
+// -------------------- WORKLOAD --------------------
+// A train and one of its classes
+struct Target {
+    int trainNo;
+    TravelClass cls;
+};
+
+struct Counts {
+    int booked;
+    int refused;
+    int released;
+    int cancelled;
+
+    Counts() {
+        booked = 0;
+        refused = 0;
+        released = 0;
+        cancelled = 0;
+    }
+};
+
+// Small LCG per thread; rand() isn't thread-safe everywhere
+static unsigned int nextRandom(unsigned int &seed) {
+    seed = seed * 1103515245u + 12345u;
+    return seed >> 8;
+}
+
+// Of every 8 operations: 4 reserve-then-book (one of them walks away and
+// releases instead), 3 plain bookings, 1 cancel of an earlier own booking
+static void worker(Database *db, const vector<Target> *targets, int ops, unsigned int seed, Counts *out) {
+    vector<string> mine;
+    int first = today() + 1;
+
+    for (int i = 0; i < ops; i++) {
+        const Target &t = (*targets)[nextRandom(seed) % targets->size()];
+        int op = nextRandom(seed) % 8;
+
+        if (op == 7) {
+            if (mine.empty()) continue;
+            int j = nextRandom(seed) % mine.size();
+            if (db->cancel(mine[j])) out->cancelled++;
+            mine[j] = mine.back();
+            mine.pop_back();
+            continue;
+        }
+
+        Booking b;
+        b.pnr = db->generatePNR();
+        b.name = "Stress";
+        b.age = 30;
+        b.trainNo = t.trainNo;
+        b.classType = t.cls;
+        b.from = -1;
+        b.to = -1;
+        b.date = first + nextRandom(seed) % DAYS;
+        b.fare = db->fares[t.cls];
+
+        bool ok;
+        if (op < 4) {
+            b.seatNo = db->reserveSeat(b.date, b.trainNo, b.classType, -1, -1);
+            if (b.seatNo >= 0 && op == 3) {
+                db->releaseSeat(b.date, b.trainNo, b.classType, b.seatNo);
+                out->released++;
+                continue;
+            }
+            ok = b.seatNo >= 0 && db->bookReserved(b);
+        } else {
+            b.seatNo = db->nextSeat(b.date, b.trainNo, b.classType, -1, -1);
+            ok = b.seatNo >= 0 && db->addBooking(b);
+        }
+
+        if (ok) {
+            out->booked++;
+            mine.push_back(b.pnr);
+        } else {
+            out->refused++;
+        }
+    }
+}
+
+// -------------------- CHECKS --------------------
+// "pnr seat date train class" per live booking, sorted. Call with no
+// other thread using db.
+static vector<string> listBookings(Database &db) {
+    vector<string> rows;
+    for (int k = 0; k < SHARD_COUNT; k++) {
+        BookingStore &bookings = db.shards[k].bookings;
+        for (int i = 0; i < bookings.slots(); i++) {
+            if (!bookings.live[i]) continue;
+            stringstream ss;
+            ss << bookings.pnr[i] << " " << bookings.seatNo[i] << " " << bookings.date[i] << " "
+               << db.pool.str(bookings.trainNo[i]) << " " << CLASS_CODES[bookings.classType[i]];
+            rows.push_back(ss.str());
+        }
+    }
+    sort(rows.begin(), rows.end());
+    return rows;
+}
+
+// Number of double-sold seats, out-of-range seats and repeated PNRs
+static int countErrors(Database &db) {
+    int errors = 0;
+    set<string> pnrs;
+    set<string> seats;
+    for (int k = 0; k < SHARD_COUNT; k++) {
+        BookingStore &bookings = db.shards[k].bookings;
+        for (int i = 0; i < bookings.slots(); i++) {
+            if (!bookings.live[i]) continue;
+
+            if (!pnrs.insert(bookings.pnr[i]).second) {
+                cerr << "PNR sold twice: " << bookings.pnr[i] << "\n";
+                errors++;
+            }
+
+            int cls = bookings.classType[i];
+            if (bookings.seatNo[i] < 1 || bookings.seatNo[i] > db.seatCapacity[cls]) {
+                cerr << "seat out of range: " << bookings.pnr[i] << " seat " << bookings.seatNo[i] << "\n";
+                errors++;
+            }
+
+            // every booking here rides the whole run
+            stringstream key;
+            key << bookings.date[i] << " " << db.pool.str(bookings.trainNo[i]) << " " << CLASS_CODES[cls] << " "
+                << bookings.seatNo[i];
+            if (!seats.insert(key.str()).second) {
+                cerr << "seat sold twice: " << key.str() << "\n";
+                errors++;
+            }
+        }
+    }
+    return errors;
+}
+
+// -------------------- RUN --------------------
+static int run(int threads, int ops) {
+    removeFiles();
+    int errors = 0;
+    vector<string> before;
+    Counts total;
+    double seconds;
+
+    {
+        Database db;
+        usePrefix(db);
+        db.loadTrains();
+        db.loadBookings();
+
+        vector<Target> targets;
+        for (int i = 0; i < db.trains.size(); i++) {
+            for (int c = 0; c < CLASS_COUNT; c++) {
+                if (!db.trains[i].hasClass((TravelClass)c)) continue;
+                Target t;
+                t.trainNo = db.trains[i].trainNo;
+                t.cls = (TravelClass)c;
+                targets.push_back(t);
+            }
+        }
+        if (targets.empty()) {
+            cerr << "No trains in " << db.trainFile << "\n";
+            return 1;
+        }
+
+        vector<Counts> counts(threads);
+        vector<thread> pool;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        for (int k = 0; k < threads; k++) {
+            int share = ops / threads + (k < ops % threads ? 1 : 0);
+            pool.push_back(thread(worker, &db, &targets, share, 12345u + 7919u * k, &counts[k]));
+        }
+        for (int k = 0; k < threads; k++) {
+            pool[k].join();
+        }
+        seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        for (int k = 0; k < threads; k++) {
+            total.booked += counts[k].booked;
+            total.refused += counts[k].refused;
+            total.released += counts[k].released;
+            total.cancelled += counts[k].cancelled;
+        }
+
+        errors += countErrors(db);
+        before = listBookings(db);
+        if ((int)before.size() != total.booked - total.cancelled) {
+            cerr << before.size() << " bookings stored, expected " << total.booked - total.cancelled << "\n";
+            errors++;
+        }
+    }
+
+    // every reply said "on disk", so a fresh load must see the same
+    {
+        Database db;
+        usePrefix(db);
+        db.loadTrains();
+        db.loadBookings();
+        if (listBookings(db) != before) {
+            cerr << "bookings differ after reload\n";
+            errors++;
+        }
+    }
+    removeFiles();
+
+    printf("%7d %7d %7d %7d %8d %9d %8.3f %9.0f %s\n", threads, ops, total.booked, total.refused, total.released,
+           total.cancelled, seconds, ops / seconds, errors == 0 ? "ok" : "FAILED");
+    return errors;
+}
+
+int main(int argc, char **argv) {
+    vector<int> threadCounts;
+    int ops = 4000;
+    if (argc > 1) {
+        threadCounts.push_back(max(toInt(argv[1]), 1));
+        if (argc > 2) ops = max(toInt(argv[2]), 1);
+    } else {
+        threadCounts.push_back(1);
+        threadCounts.push_back(8);
+        threadCounts.push_back(32);
+    }
+
+    printf("threads     ops  booked refused released cancelled  seconds     ops/s\n");
+    int errors = 0;
+    for (int i = 0; i < threadCounts.size(); i++) {
+        errors += run(threadCounts[i], ops);
+    }
+    return errors == 0 ? 0 : 1;
+}